@@ -591,19 +591,21 @@ char *yytext;
 #include <ctype.h>
 #include <parser.h>
      
-struct obstack string_stk;
-
 int line_num;
-char *filename;
-char *canonical_filename; 
+char *filename;            /* Name of the current file */
+int filename_id;           /* Its id in the file table */
+int canonical_filename_id; /* Id of the file being processed */
 YYSTYPE yylval;
 unsigned input_file_count; /* Number of input files, processed by source() */
+long input_offset;         /* Offset of the next input character */
+long token_offset;         /* Offset of the last token read */
  
 int ident();
 void update_loc();
 #define lex_error(msg) error_at_line(0, 0, filename, line_num, "%s", msg)
+#define YY_USER_ACTION token_offset = input_offset; input_offset += yyleng;
 
-#line 607 "c.c"
+#line 609 "c.c"
 
 /* Macros after this point can all be overridden by user definitions in
  * section 1.
@@ -760,7 +762,7 @@ YY_DECL
 #line 48 "c.l"
 
      /* comments */
-#line 764 "c.c"
+#line 766 "c.c"
 
 	if ( yy_init )
 		{
@@ -947,22 +949,23 @@ return TYPEDEF;
 case 18:
 YY_RULE_SETUP
 #line 70 "c.l"
-{yylval.str = "struct"; return STRUCT;}
+{yylval.str = "struct"; yylval.len = 6; return STRUCT;}
 	YY_BREAK
 case 19:
 YY_RULE_SETUP
 #line 71 "c.l"
-{yylval.str = "union"; return STRUCT;}
+{yylval.str = "union"; yylval.len = 5; return STRUCT;}
 	YY_BREAK
 case 20:
 YY_RULE_SETUP
 #line 72 "c.l"
-{yylval.str = "enum"; return STRUCT;}
+{yylval.str = "enum"; yylval.len = 4; return STRUCT;}
 	YY_BREAK
 case 21:
 YY_RULE_SETUP
 #line 73 "c.l"
 { yylval.str = "*";
+		       yylval.len = 1;
 		       return MODIFIER;
 		   }
 	YY_BREAK
@@ -970,106 +973,107 @@ YY_RULE_SETUP
       *
       */
 case 22:
-#line 80 "c.l"
+#line 82 "c.l"
 case 23:
 YY_RULE_SETUP
-#line 80 "c.l"
+#line 82 "c.l"
 return MEMBER_OF;
 	YY_BREAK
 case 24:
-#line 82 "c.l"
+#line 84 "c.l"
 case 25:
-#line 83 "c.l"
+#line 85 "c.l"
 case 26:
-#line 84 "c.l"
+#line 86 "c.l"
 case 27:
-#line 85 "c.l"
+#line 87 "c.l"
 case 28:
-#line 86 "c.l"
+#line 88 "c.l"
 case 29:
-#line 87 "c.l"
+#line 89 "c.l"
 case 30:
-#line 88 "c.l"
+#line 90 "c.l"
 case 31:
-#line 89 "c.l"
+#line 91 "c.l"
 case 32:
-#line 90 "c.l"
+#line 92 "c.l"
 case 33:
-#line 91 "c.l"
+#line 93 "c.l"
 case 34:
-#line 92 "c.l"
+#line 94 "c.l"
 case 35:
-#line 93 "c.l"
+#line 95 "c.l"
 case 36:
-#line 94 "c.l"
+#line 96 "c.l"
 case 37:
-#line 95 "c.l"
+#line 97 "c.l"
 case 38:
-#line 96 "c.l"
+#line 98 "c.l"
 case 39:
-#line 97 "c.l"
+#line 99 "c.l"
 case 40:
-#line 98 "c.l"
+#line 100 "c.l"
 case 41:
-#line 99 "c.l"
+#line 101 "c.l"
 case 42:
-#line 100 "c.l"
+#line 102 "c.l"
 case 43:
-#line 101 "c.l"
+#line 103 "c.l"
 case 44:
-#line 102 "c.l"
+#line 104 "c.l"
 case 45:
 YY_RULE_SETUP
-#line 102 "c.l"
+#line 104 "c.l"
 return OP;
 	YY_BREAK
 case 46:
-#line 104 "c.l"
+#line 106 "c.l"
 case 47:
-#line 105 "c.l"
+#line 107 "c.l"
 case 48:
-#line 106 "c.l"
+#line 108 "c.l"
 case 49:
 YY_RULE_SETUP
-#line 106 "c.l"
+#line 108 "c.l"
 return STRING;
 	YY_BREAK
 /* Identifiers and constants
       *
       */
 case 50:
-#line 111 "c.l"
+#line 113 "c.l"
 case 51:
 YY_RULE_SETUP
-#line 111 "c.l"
+#line 113 "c.l"
 return ident();
 	YY_BREAK
 case 52:
 YY_RULE_SETUP
-#line 112 "c.l"
-{ obstack_grow(&string_stk, yytext, yyleng+1);
-			  yylval.str = obstack_finish(&string_stk);
+#line 114 "c.l"
+{ yylval.str = yytext;
+			  yylval.len = yyleng;
 			  return WORD;
 		      }
 	YY_BREAK
 case 53:
 YY_RULE_SETUP
-#line 116 "c.l"
+#line 119 "c.l"
 { yyless(yyleng-1);
-			  obstack_grow(&string_stk, yytext, yyleng+1);
-			  yylval.str = obstack_finish(&string_stk);
+			  input_offset--;
+			  yylval.str = yytext;
+			  yylval.len = yyleng;
 			  return WORD;}
 	YY_BREAK
 case 54:
-#line 121 "c.l"
+#line 126 "c.l"
 case 55:
-#line 122 "c.l"
+#line 127 "c.l"
 case 56:
 YY_RULE_SETUP
-#line 122 "c.l"
+#line 127 "c.l"
 {
-    obstack_grow(&string_stk, yytext, yyleng+1);
-    yylval.str = obstack_finish(&string_stk);
+    yylval.str = yytext;
+    yylval.len = yyleng;
     return WORD;
 }
 	YY_BREAK
@@ -1082,90 +1086,91 @@ YY_RULE_SETUP
       */
 case 57:
 YY_RULE_SETUP
-#line 135 "c.l"
+#line 141 "c.l"
 BEGIN(string);
 	YY_BREAK
 case 58:
 YY_RULE_SETUP
-#line 136 "c.l"
+#line 142 "c.l"
 ;
 	YY_BREAK
 case 59:
 YY_RULE_SETUP
-#line 137 "c.l"
+#line 143 "c.l"
 { ++line_num; lex_error(_("unterminated string?")); } 
 	YY_BREAK
 case 60:
 YY_RULE_SETUP
-#line 138 "c.l"
+#line 144 "c.l"
 ;
 	YY_BREAK
 case 61:
 YY_RULE_SETUP
-#line 139 "c.l"
+#line 145 "c.l"
 ++line_num;
 	YY_BREAK
 case 62:
 YY_RULE_SETUP
-#line 140 "c.l"
+#line 146 "c.l"
 BEGIN(stringwait);
 	YY_BREAK
 case 63:
 YY_RULE_SETUP
-#line 141 "c.l"
+#line 147 "c.l"
 ;
 	YY_BREAK
 case 64:
 YY_RULE_SETUP
-#line 142 "c.l"
+#line 148 "c.l"
 ++line_num; 
 	YY_BREAK
 case 65:
 YY_RULE_SETUP
-#line 143 "c.l"
+#line 149 "c.l"
 BEGIN(string);
 	YY_BREAK
 case 66:
 YY_RULE_SETUP
-#line 144 "c.l"
+#line 150 "c.l"
 {
      BEGIN(INITIAL);
      yyless(0); /* put the symbol back */
+     input_offset = token_offset;
      return STRING;
 }
 	YY_BREAK
 case 67:
 YY_RULE_SETUP
-#line 149 "c.l"
+#line 156 "c.l"
 ++line_num;
 	YY_BREAK
 case 68:
 YY_RULE_SETUP
-#line 150 "c.l"
+#line 157 "c.l"
 ;
 	YY_BREAK
 /*\f                      ;*/
 case 69:
 YY_RULE_SETUP
-#line 152 "c.l"
+#line 159 "c.l"
 return LBRACE0;
 	YY_BREAK
 case 70:
 YY_RULE_SETUP
-#line 153 "c.l"
+#line 160 "c.l"
 return RBRACE0;
 	YY_BREAK
 case 71:
 YY_RULE_SETUP
-#line 154 "c.l"
+#line 161 "c.l"
 return yytext[0];
 	YY_BREAK
 case 72:
 YY_RULE_SETUP
-#line 155 "c.l"
+#line 162 "c.l"
 ECHO;
 	YY_BREAK
-#line 1169 "c.c"
+#line 1174 "c.c"
 case YY_STATE_EOF(INITIAL):
 case YY_STATE_EOF(comment):
 case YY_STATE_EOF(string):
@@ -2053,7 +2058,7 @@ int main()
 	return 0;
 	}
 #endif
-#line 155 "c.l"
+#line 162 "c.l"
 
 
 static char *keywords[] = {
@@ -2088,6 +2093,43 @@ static char *types[] = {
     "volatile",
 };
 
+/* Builtin keywords and types are found by a perfect hash function of
+   the length and the first and last characters of the name, so that
+   recognizing them costs neither hashing the whole name nor probing
+   the symbol table. The constants were found by exhaustive search over
+   keywords[], types[] and "...". BUILTIN_HASH_SIZE must be a power
+   of 2. */
+#define BUILTIN_HASH_SIZE 64
+#define BUILTIN_HASH(s, len) \
+     (((len) + 9 * (unsigned char)(s)[0] + 3 * (unsigned char)(s)[(len)-1]) \
+      & (BUILTIN_HASH_SIZE - 1))
+
+/* Symbols installed by init_lex(). install() never moves a symbol
+   once it is in the table, so these stay valid even if the names are
+   redefined later. */
+static Symbol *builtin[BUILTIN_HASH_SIZE];
+
+static void
+install_builtin(Symbol *sp)
+{
+     unsigned n = BUILTIN_HASH(sp->name, strlen(sp->name));
+
+     if (builtin[n])
+	  error(10, 0, _("INTERNAL ERROR: builtin hash collision: %s, %s"),
+		builtin[n]->name, sp->name);
+     builtin[n] = sp;
+}
+
+static Symbol *
+lookup_builtin(char *text, int len)
+{
+     Symbol *sp = builtin[BUILTIN_HASH(text, len)];
+
+     if (sp && sp->len == len && memcmp(sp->name, text, len) == 0)
+	  return sp;
+     return NULL;
+}
+
 void
 init_lex(int debug_level)
 {
@@ -2096,43 +2138,55 @@ init_lex(int debug_level)
     
      yy_flex_debug = debug_level;
      
-     obstack_init(&string_stk);
-
      for (i = 0; i < NUMITEMS(keywords); i++) {
 	  sp = install(keywords[i]);
 	  sp->type = SymToken;
 	  sp->token_type = WORD;
+	  install_builtin(sp);
      }
      
      for (i = 0; i < NUMITEMS(types); i++) {
 	  sp = install(types[i]);
 	  sp->type = SymToken;
 	  sp->token_type = TYPE;
-	  sp->source = NULL;
+	  sp->source = 0;
 	  sp->def_line = -1;
 	  sp->ref_line = NULL;
+	  install_builtin(sp);
      }	
      sp = install("...");
      sp->type = SymToken;
      sp->token_type = IDENTIFIER;
-     sp->source = NULL;
+     sp->source = 0;
      sp->def_line = -1;
      sp->ref_line = NULL;
+     install_builtin(sp);
 }
 
+static int skip_idents; /* Return identifiers without looking them up */
+
 int
 ident()
 {
      Symbol *sp;
+     unsigned hash;
 
-     sp = lookup(yytext);
+     if (skip_idents)
+	  return IDENTIFIER;
+     sp = lookup_builtin(yytext, yyleng);
+     if (sp)
+	  hash = sp->hash;
+     else {
+	  hash = name_hash(yytext, yyleng);
+	  sp = lookup_hashed(yytext, yyleng, hash);
+     }
+     yylval.hash = hash;
+     yylval.len = yyleng;
      if (sp && sp->type == SymToken) {
 	  yylval.str = sp->name;
 	  return sp->token_type;
      }
-     obstack_grow(&string_stk, yytext, yyleng);
-     obstack_1grow(&string_stk, 0);
-     yylval.str = obstack_finish(&string_stk);
+     yylval.str = yytext;
      return IDENTIFIER;
 }
 
@@ -2224,20 +2278,54 @@ yywrap()
 #ifdef FLEX_SCANNER
      yy_delete_buffer(yy_current_buffer);
 #endif
-     delete_statics();
+     if (lazy_option)
+	  end_unit();
+     else
+	  delete_statics();
+     /* Pending declarations may refer to the scratch names */
+     finish_decls();
+     reset_scratch();
      return 1;
 }
 
+static char *input_buffer; /* Contents of the current input file */
+static size_t input_size;  /* and its size */
+
+/* Make flex scan the SIZE bytes at BUF, which are followed by two NUL
+   bytes. The input file is kept in the buffer state, because flex
+   copies it from there to yyin whenever it switches buffers. */
+static void
+flex_scan(char *buf, size_t size)
+{
+     FILE *fp = yyin;
+     YY_BUFFER_STATE b = yy_scan_buffer(buf, size + 2);
+     b->yy_input_file = yyin = fp;
+}
+
+/* Stop scanning the current buffer, putting back the character flex
+   has replaced with a NUL */
+static void
+flex_close()
+{
+     if (YY_CURRENT_BUFFER) {
+	  *yy_c_buf_p = yy_hold_char;
+	  yy_delete_buffer(YY_CURRENT_BUFFER);
+     }
+}
+
 int
 get_token()
 {
-     return yyin ? yylex() : 0;
+     if (!yyin)
+	  return 0;
+     return fast_lexer_option ? scan_token() : yylex();
 }
 
 int
 source(char *name)
 {
      FILE *fp;
+     size_t len;
 
      fp = fopen(name, "r");
      if (!fp) {
@@ -2250,16 +2338,105 @@ source(char *name)
 	  if (!fp)
 	       return 1;
      }
-     obstack_grow(&string_stk, name, strlen(name)+1);
-     filename = obstack_finish(&string_stk);
-     canonical_filename = filename;
+     len = strlen(name);
+     set_filename(file_id(name, len, name_hash(name, len)));
+     canonical_filename_id = filename_id;
      line_num = 1;
      input_file_count++;
+     input_offset = 0;
      
-     yyrestart(fp);
+     yyin = fp;
+     finish_decls();
+     input_buffer = read_input(fp, &input_size);
+     /* Guess the number of distinct names from the input size */
+     reserve_symbols(input_size / 64);
+     if (fast_lexer_option) {
+	  scan_open();
+	  if (pipeline_option)
+	       scan_pipeline();
+     } else
+	  flex_scan(input_buffer, input_size);
      return 0;
 }
 
+/* Skip the rest of a function body, whose opening brace has just been
+   read. Only the braces are looked at: identifiers are not looked up
+   and no text is saved. Return the closing token, or 0 on end of
+   file. */
+int
+skip_body()
+{
+     int type;
+     int lev = 1;
+
+     skip_idents = 1;
+     while (lev && (type = get_token())) {
+	  switch (type) {
+	  case LBRACE0:
+	  case '{':
+	       lev++;
+	       break;
+	  case RBRACE0:
+	       if (use_indentation) {
+		    lev = 0;
+		    break;
+	       }
+	       /* FALLTHRU */
+	  case '}':
+	       lev--;
+	       break;
+	  }
+     }
+     skip_idents = 0;
+     return type;
+}
+
+/* Resume reading the source file NAME at the given OFFSET. NAME must
+   be a file that has already been processed by source(), since
+   the current filename and line_num are not changed. */
+int
+resume_source(char *name, long offset)
+{
+     static char *resumed_name;
+
+     if (yyin && name != resumed_name)
+	  close_source();
+     if (!yyin) {
+	  yyin = fopen(name, "r");
+	  if (!yyin) {
+	       error(0, errno, _("cannot open `%s'"), name);
+	       return 1;
+	  }
+	  resumed_name = name;
+	  finish_decls();
+	  input_buffer = read_input(yyin, &input_size);
+	  if (fast_lexer_option)
+	       scan_open();
+     }
+     if (fast_lexer_option) {
+	  scan_seek(offset);
+	  return 0;
+     }
+     if (offset > input_size)
+	  offset = input_size;
+     flex_close();
+     input_offset = offset;
+     BEGIN(INITIAL);
+     flex_scan(input_buffer + offset, input_size - offset);
+     return 0;
+}
+
+/* Close the file opened by resume_source() */
+void
+close_source()
+{
+     if (yyin) {
+	  flex_close();
+	  fclose(yyin);
+	  yyin = NULL;
+     }
+}
+
 static int
 getnum(unsigned  base, int  count)
 {
@@ -2298,6 +2475,14 @@ backslash()
      return c;                                         
 }                                                     
 
+/* Make the file with the given ID current */
+void
+set_filename(int id)
+{
+     filename_id = id;
+     filename = file_name(id);
+}
+
 void
 update_loc()
 {
@@ -2316,9 +2501,7 @@ update_loc()
 	  
 	  for (p++, n = 0; p[n] && p[n] != '"'; n++)
 	       ;
-	  obstack_grow(&string_stk, p, n);
-	  obstack_1grow(&string_stk, 0);
-	  filename = obstack_finish(&string_stk);
+	  set_filename(file_id(p, n, name_hash(p, n)));
      }
      if (debug > 1)
 	  printf(_("New location: %s:%d\n"), filename, line_num);
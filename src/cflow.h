@@ -75,7 +75,7 @@ enum storage {
 
 typedef struct {
      int line;
-     char *source;
+     int source;                   /* Id of the source file */
 } Ref;
 
 enum symbol_flag {
@@ -86,41 +86,89 @@ enum symbol_flag {
 };
 
 typedef struct symbol Symbol;
+struct body;
+struct ref_list;
+
+/* A list of symbols, such as the callers or the callees of a function.
+   Short lists are kept in the structure itself, longer ones in an array
+   of their own. */
+#define SYMBOL_LIST_INLINE 1
+
+struct symbol_list {
+     unsigned count;               /* Number of elements */
+     unsigned max;                 /* Size of the array, 0 while the
+				      elements are kept inline */
+     union {
+	  Symbol *inl[SYMBOL_LIST_INLINE];
+	  Symbol **vec;
+     } v;
+};
+
+#define SYMBOL_LIST_PTR(l) ((l)->max ? (l)->v.vec : (l)->v.inl)
 
+/* A declaration whose text has not been composed yet. The tokens it
+   consists of follow it in memory (see save_decl in parser.c). */
+struct pending_decl {
+     Symbol *owner;                /* Symbol it declares */
+     struct pending_decl *next;    /* Next pending declaration */
+     int count;                    /* Number of tokens */
+};
+
+/* The members used by lookups, symbol table walks, include_symbol()
+   and the output traversal come first, so that they fit in one cache
+   line; the rest is only looked at when a symbol is defined or
+   printed. */
 struct symbol {
      Symbol *next;                 /* Next symbol with the same hash */
-     enum symtype type;            /* Type of the symbol */
      char *name;                   /* Identifier */
-     enum symbol_flag flag;        /* Specific flag */
-     
+     unsigned hash;                /* Hash value of the name */
+     unsigned len;                 /* Length of the name */
      int active;                   /* Set to 1 when the symbol's subtree is
 				      being processed, prevent recursion */
-     int expand_line;              /* Output line when this symbol was first
-				      expanded */
-
-     int token_type;               /* Type of the token */
-     char *source;                 /* Source file */
-     int def_line;                 /* Source line */
-     Consptr ref_line;             /* Referenced in */
-     
-     int level;                    /* Block nesting level (for local vars),
-				      Parameter nesting level (for params) */
-     
-     char *decl;                   /* Declaration */ 
-     enum storage storage;         /* Storage type */
-     
      int arity;                    /* Number of parameters or -1 for
 				      variables */  
-     
-     int recursive;                /* Is the function recursive */
-     Consptr caller;               /* List of callers */
-     Consptr callee;               /* List of callees */
+     int level;                    /* Block nesting level (for local vars),
+				      Parameter nesting level (for params) */
+     int source;                   /* Source file id, 0 if none */
+     enum symtype type : 2;        /* Type of the symbol */
+     enum symbol_flag flag : 2;    /* Specific flag */
+     enum storage storage : 3;     /* Storage type */
+     unsigned recursive : 1;       /* Is the function recursive */
+     unsigned included : 1;        /* Is the symbol included in the output
+				      (see update_inclusion) */
+     unsigned decl_pending : 1;    /* Is decl.pending valid */
+     unsigned scratch_name : 1;    /* Is the name in the scratch area
+				      (see reset_scratch) */
+     unsigned linked : 1;          /* Has the symbol been put on a caller
+				      or callee list (see sweep_symbols) */
+     int token_type : 16;          /* Type of the token */
+     struct symbol_list callee;    /* List of callees */
+     struct symbol_list caller;    /* List of callers */
+
+     int def_line;                 /* Source line */
+     int expand_line;              /* Output line when this symbol was first
+				      expanded */
+     struct ref_list *ref_line;    /* Referenced in */
+     union {
+	  char *text;              /* Declaration, see symbol_decl() */
+	  struct pending_decl *pending;
+     } decl;
+     struct body *body;            /* Function bodies not parsed yet
+				      (lazy mode) */
 };
 
 /* Output flags */
 #define PRINT_XREF 0x01
 #define PRINT_TREE 0x02
 
+/* Collection flags: what the parser has to record for the output */
+#define COLLECT_REFS       0x01  /* Reference lines */
+#define COLLECT_CALLS      0x02  /* Caller and callee lists */
+#define COLLECT_UNDERSCORE 0x04  /* References to the symbols whose
+				    names begin with an underscore */
+#define STREAM_XREF        0x08  /* Print the cross-reference lines
+				    instead of collecting them */
+
 #ifndef CFLOW_PREPROC
 # define CFLOW_PREPROC "/usr/bin/cpp"
 #endif
@@ -133,6 +181,7 @@ extern char *outname;
 
 extern int verbose;
 extern int print_option;
+extern int collect_plan;
 extern int use_indentation;
 extern int assume_cplusplus;
 extern int record_defines;
@@ -146,8 +195,13 @@ extern int print_as_tree;
 extern int brief_listing;
 extern int reverse_tree;
 extern int out_line;
-extern char *start_name;
+extern char **start_names;
+extern size_t start_name_count;
+extern int auto_start_option;
 extern int max_depth;
+extern unsigned long max_nodes;
+extern int estimate_option;
+extern unsigned long max_memory;
 extern int emacs_option;
 extern int debug;
 extern int preprocess_option;
@@ -159,32 +213,72 @@ extern int token_stack_increase;
 
 extern int symbol_count;
 extern unsigned input_file_count;
-
+extern int lazy_option;
+extern int jobs_option;
+extern int output_jobs_option;
+extern int partial_option;
+extern int merge_option;
+extern int fast_lexer_option;
+extern int pipeline_option;
+
+unsigned name_hash(const char *text, size_t len);
+char *intern(const char *text, size_t len, unsigned hash);
+char *intern_string(const char *str);
+int file_id(const char *name, size_t len, unsigned hash);
+char *file_name(int id);
 Symbol *lookup(char*);
+Symbol *lookup_hashed(char *name, size_t len, unsigned hash);
+Symbol *find_in_chain(Symbol *head, enum symtype type);
 Symbol *install(char*);
+Symbol *install_hashed(char *name, size_t len, unsigned hash);
 void delete_autos(int level);
+void reserve_symbols(size_t count);
 void delete_statics(void);
+void reset_scratch(void);
 void delete_parms(int level);
 void move_parms(int level);
 void cleanup(void);
 int collect_symbols(Symbol ***, int (*sel)());
 Consptr append_to_list(Consptr *, void *);
-int symbol_in_list(Symbol *sym, Consptr list);
+void symbol_list_append(struct symbol_list *list, Symbol *sym);
+int symbol_in_list(Symbol *sym, struct symbol_list *list);
+void symbol_list_free(struct symbol_list *list);
+void add_ref(struct ref_list **plist, int source, int line);
+int next_ref(struct ref_list *list, size_t *pos, Ref *ref);
+char **parm_names(void);
+size_t detach_unit_symbols(Symbol ***return_sym);
+void attach_symbols(Symbol **sym, size_t num);
 
 int get_token(void);
 int source(char *name);
+int skip_body(void);
+int resume_source(char *name, long offset);
+void close_source(void);
 void init_lex(int debug_level);
 void set_preprocessor(const char *arg);
 void pp_option(const char *arg); 
 
 void init_parse(void);
+char *symbol_decl(Symbol *sp);
 int yyparse(void);
-
+void end_unit(void);
+void moved_bodies(Symbol *sp);
+void parse_bodies(void);
+void begin_partial(void);
+void end_partial(void);
+void merge_partial(char *name);
+
+void open_output(void);
 void output(void);
+void xref_definition(Symbol *symp);
+void xref_reference(Symbol *symp, int line);
 void newline(void);
 void print_level(int lev, int last);
 int globals_only(void);
-int include_symbol(Symbol *sym);
+int select_symbol(Symbol *sym);
+void update_inclusion(void);
+void mark_symbols(int (*sel)(Symbol *));
+#define include_symbol(sym) ((sym)->included)
 
 void sourcerc(int *, char ***);
 
@@ -21,13 +21,15 @@
 void
 print_function_name(Symbol *sym, int has_subtree)
 {
+     char *decl = symbol_decl(sym);
+     
      fprintf(outfile, "%s", sym->name);
      if (sym->arity >= 0)
 	  fprintf(outfile, "()");
-     if (sym->decl)
+     if (decl)
 	  fprintf(outfile, " <%s at %s:%d>",
-		  sym->decl,
-		  sym->source,
+		  decl,
+		  file_name(sym->source),
 		  sym->def_line);
      if (sym->active) {
 	  fprintf(outfile, " (recursive: see %d)", sym->active-1);
@@ -44,8 +46,8 @@ static int
 print_symbol(FILE *outfile, int line, struct output_symbol *s)
 {
      int has_subtree = s->direct ? 
- 	                  s->sym->callee != NULL :
-	                  s->sym->caller != NULL;
+ 	                  s->sym->callee.count != 0 :
+	                  s->sym->caller.count != 0;
      
      print_level(s->level, s->last);
      print_function_name(s->sym, has_subtree);
@@ -54,7 +56,7 @@ print_symbol(FILE *outfile, int line, struct output_symbol *s)
 	  if (s->sym->expand_line) {
 	       fprintf(outfile, " [see %d]", s->sym->expand_line);
 	       return 1;
-	  } else if (s->sym->callee)
+	  } else if (s->sym->callee.count)
 	       s->sym->expand_line = line;
      }
      return 0;
@@ -21,6 +21,7 @@
 #include <stdarg.h>
 #include <parser.h>
 #include <strndup.h>
+#include <limits.h>
 
 const char *argp_program_version = "cflow (" PACKAGE_NAME ") " VERSION;
 const char *argp_program_bug_address = "<" PACKAGE_BUGREPORT ">";
@@ -47,7 +48,26 @@ enum option_code {
      OPT_OMIT_ARGUMENTS,
      OPT_NO_OMIT_ARGUMENTS,
      OPT_OMIT_SYMBOL_NAMES,
-     OPT_NO_OMIT_SYMBOL_NAMES
+     OPT_NO_OMIT_SYMBOL_NAMES,
+     OPT_LAZY,
+     OPT_NO_LAZY,
+     OPT_FAST_LEXER,
+     OPT_NO_FAST_LEXER,
+     OPT_PIPELINE,
+     OPT_NO_PIPELINE,
+     OPT_UNSORTED,
+     OPT_NO_UNSORTED,
+     OPT_AUTO_START,
+     OPT_NO_AUTO_START,
+     OPT_MAX_NODES,
+     OPT_ESTIMATE,
+     OPT_NO_ESTIMATE,
+     OPT_OUTPUT_JOBS,
+     OPT_MAX_MEMORY,
+     OPT_PARTIAL,
+     OPT_NO_PARTIAL,
+     OPT_MERGE,
+     OPT_NO_MERGE
 };
 
 static struct argp_option options[] = {
@@ -56,6 +76,18 @@ static struct argp_option options[] = {
        N_("General options:"), GROUP_ID },
      { "depth", 'd', N_("NUMBER"), 0,
        N_("Set the depth at which the flowgraph is cut off"), GROUP_ID+1 },
+     { "max-nodes", OPT_MAX_NODES, N_("NUMBER"), 0,
+       N_("Stop the flowgraph output after NUMBER nodes"), GROUP_ID+1 },
+     { "estimate", OPT_ESTIMATE, NULL, 0,
+       N_("* Print the number of nodes in each flowgraph instead of the flowgraphs"),
+       GROUP_ID+1 },
+     { "no-estimate", OPT_NO_ESTIMATE, NULL, OPTION_HIDDEN,
+       "", GROUP_ID+1 },
+     { "output-jobs", OPT_OUTPUT_JOBS, N_("NUMBER"), 0,
+       N_("Output the flowgraphs in NUMBER parallel processes"), GROUP_ID+1 },
+     { "max-memory", OPT_MAX_MEMORY, N_("SIZE"), 0,
+       N_("Keep at most SIZE bytes of cross-references in memory, the rest in a temporary file. SIZE may end with k, M or G"),
+       GROUP_ID+1 },
      { "include", 'i', N_("CLASSES"), 0,
        N_("Include specified classes of symbols (see below). Prepend CLASSES with ^ or - to exclude them from the output"), GROUP_ID+1 },
      { "format", 'f', N_("NAME"), 0,
@@ -65,12 +97,27 @@ static struct argp_option options[] = {
        N_("* Print reverse call tree"), GROUP_ID+1 },
      { "xref", 'x', NULL, 0,
        N_("Produce cross-reference listing only"), GROUP_ID+1 },
+     { "unsorted", OPT_UNSORTED, NULL, 0,
+       N_("* Print cross-reference lines in the order they are found, without sorting them"),
+       GROUP_ID+1 },
+     { "no-unsorted", OPT_NO_UNSORTED, NULL, OPTION_HIDDEN,
+       "", GROUP_ID+1 },
      { "print", 'P', N_("OPT"), OPTION_HIDDEN,
        N_("Set printing option to OPT. Valid OPT values are: xref (or cross-ref), tree. Any unambiguous abbreviation of the above is also accepted"),
        GROUP_ID+1 },
      { "output", 'o', N_("FILE"), 0,
        N_("Set output file name (default -, meaning stdout)"),
        GROUP_ID+1 },
+     { "partial", OPT_PARTIAL, NULL, 0,
+       N_("* Write a partial graph of the input files instead of the output, for use with --merge"),
+       GROUP_ID+1 },
+     { "no-partial", OPT_NO_PARTIAL, NULL, OPTION_HIDDEN,
+       "", GROUP_ID+1 },
+     { "merge", OPT_MERGE, NULL, 0,
+       N_("* Read partial graphs written by --partial instead of source files"),
+       GROUP_ID+1 },
+     { "no-merge", OPT_NO_MERGE, NULL, OPTION_HIDDEN,
+       "", GROUP_ID+1 },
 
      { NULL, 0, NULL, 0, N_("Symbols classes for --include argument"), GROUP_ID+2 },
      {"  x", 0, NULL, OPTION_DOC|OPTION_NO_TRANS,
@@ -100,7 +147,25 @@ static struct argp_option options[] = {
      { "symbol", 's', N_("SYMBOL:TYPE"), 0,
        N_("Register SYMBOL with given TYPE. Valid types are: keyword (or kw), modifier, identifier, type, wrapper. Any unambiguous abbreviation of the above is also accepted"), GROUP_ID+1 },
      { "main", 'm', N_("NAME"), 0,
-       N_("Assume main function to be called NAME"), GROUP_ID+1 },
+       N_("Assume main function to be called NAME. If given several times, print a graph for each NAME"), GROUP_ID+1 },
+     { "auto-start", OPT_AUTO_START, NULL, 0,
+       N_("* Start graphs from the functions that are not called by any other function"), GROUP_ID+1 },
+     { "no-auto-start", OPT_NO_AUTO_START, NULL, OPTION_HIDDEN,
+       "", GROUP_ID+1 },
+     { "lazy", OPT_LAZY, NULL, 0,
+       N_("* Parse only the bodies of functions reachable from the main function"), GROUP_ID+1 },
+     { "no-lazy", OPT_NO_LAZY, NULL, OPTION_HIDDEN,
+       "", GROUP_ID+1 },
+     { "jobs", 'j', N_("NUMBER"), 0,
+       N_("Parse function bodies in NUMBER parallel processes (implies --lazy)"), GROUP_ID+1 },
+     { "fast-lexer", OPT_FAST_LEXER, NULL, 0,
+       N_("* Use the built-in hand-written lexical analyzer"), GROUP_ID+1 },
+     { "no-fast-lexer", OPT_NO_FAST_LEXER, NULL, OPTION_HIDDEN,
+       "", GROUP_ID+1 },
+     { "pipeline", OPT_PIPELINE, NULL, 0,
+       N_("* Run the lexical analyzer in a separate thread (implies --fast-lexer)"), GROUP_ID+1 },
+     { "no-pipeline", OPT_NO_PIPELINE, NULL, OPTION_HIDDEN,
+       "", GROUP_ID+1 },
      { "define", 'D', N_("NAME[=DEFN]"), 0,
        N_("Predefine NAME as a macro"), GROUP_ID+1 },
      { "undefine", 'U', N_("NAME"), 0,
@@ -191,6 +256,7 @@ struct option_type {
 int debug;              /* debug level */
 char *outname = "-";    /* default output file name */
 int print_option = 0;   /* what to print. */
+int collect_plan;       /* what to collect, see collection_plan() */
 int verbose;            /* be verbose on output */
 int use_indentation;    /* Rely on indentation,
 			 * i.e. suppose the function body
@@ -205,9 +271,28 @@ int print_as_tree;      /* Print as tree */
 int brief_listing;      /* Produce short listing */
 int reverse_tree;       /* Generate reverse tree */
 int max_depth;          /* The depth at which the flowgraph is cut off */
+unsigned long max_nodes; /* The number of nodes after which the output
+			   stops */
+int estimate_option;    /* Print the sizes of the flowgraphs */
 int emacs_option;       /* Format and check for use with Emacs cflow-mode */ 
 int omit_arguments_option;    /* Omit arguments from function declaration string */
 int omit_symbol_names_option; /* Omit symbol name from symbol declaration string */
+int lazy_option;        /* Parse function bodies on demand */
+int jobs_option;        /* Number of processes parsing function bodies */
+int output_jobs_option; /* Number of processes producing the output */
+unsigned long max_memory; /* Memory the cross-references may take before
+			     they are spilled to disk, 0 for no limit */
+int partial_option;     /* Write a partial graph */
+int merge_option;       /* Read partial graphs */
+
+/* Define CFLOW_FAST_LEXER to 1 to make --fast-lexer the default */
+#ifndef CFLOW_FAST_LEXER
+# define CFLOW_FAST_LEXER 0
+#endif
+int fast_lexer_option = CFLOW_FAST_LEXER; /* Use scan_token() instead
+					     of yylex() */
+int pipeline_option;    /* Run scan_next() in a thread of its own */
+int unsorted_option;    /* Print cross-references while parsing */
 
 #define SM_FUNCTIONS   0x0001
 #define SM_DATA        0x0002
@@ -229,7 +314,9 @@ char *level_begin = "";
 
 int preprocess_option = 0; /* Do they want to preprocess sources? */
 
-char *start_name = "main"; /* Name of start symbol */
+char **start_names;       /* Names of start symbols */
+size_t start_name_count;  /* and their number */
+int auto_start_option;    /* Select the start symbols automatically */
 
 Consptr arglist;        /* List of command line arguments */
 
@@ -287,7 +374,7 @@ symbol_override(const char *str)
      sp = install(name);
      sp->type = SymToken;
      sp->token_type = type;
-     sp->source = NULL;
+     sp->source = 0;
      sp->def_line = -1;
      sp->ref_line = NULL;
 }
@@ -510,10 +597,36 @@ add_preproc_option(int key, const char *arg)
      preprocess_option = 1;
 }
 
+/* Parse the unsigned decimal number at the start of ARG into *NP and
+   set *ENDP to the character that follows it. Return 0 on success and
+   -1 if ARG does not start with a digit or the number is too large. */
+static int
+parse_number(char *arg, char **endp, unsigned long *np)
+{
+     if (!isdigit((unsigned char) *arg))
+	  return -1;
+     errno = 0;
+     *np = strtoul(arg, endp, 10);
+     return errno == ERANGE ? -1 : 0;
+}
+
+/* Parse the number of processes given in ARG */
+static int
+parse_jobs(char *arg)
+{
+     char *p;
+     unsigned long n;
+
+     if (parse_number(arg, &p, &n) || *p || n == 0 || n > INT_MAX)
+	  error(1, 0, _("invalid number of jobs: %s"), arg);
+     return n;
+}
+
 static error_t
 parse_opt (int key, char *arg, struct argp_state *state)
 {
      int num;
+     char *p;
      
      switch (key) {
      case 'a':
@@ -535,6 +648,36 @@ parse_opt (int key, char *arg, struct argp_state *state)
      case 'S':
 	  use_indentation = 1;
 	  break;
+     case OPT_LAZY:
+	  lazy_option = 1;
+	  break;
+     case OPT_NO_LAZY:
+	  lazy_option = 0;
+	  break;
+     case 'j':
+	  jobs_option = parse_jobs(arg);
+	  break;
+     case OPT_OUTPUT_JOBS:
+	  output_jobs_option = parse_jobs(arg);
+	  break;
+     case OPT_FAST_LEXER:
+	  fast_lexer_option = 1;
+	  break;
+     case OPT_NO_FAST_LEXER:
+	  fast_lexer_option = 0;
+	  break;
+     case OPT_PIPELINE:
+	  pipeline_option = 1;
+	  break;
+     case OPT_NO_PIPELINE:
+	  pipeline_option = 0;
+	  break;
+     case OPT_UNSORTED:
+	  unsorted_option = 1;
+	  break;
+     case OPT_NO_UNSORTED:
+	  unsorted_option = 0;
+	  break;
      case OPT_NO_USE_INDENTATION:
 	  use_indentation = 0;
 	  break;
@@ -561,6 +704,50 @@ parse_opt (int key, char *arg, struct argp_state *state)
 	  if (max_depth < 0)
 	       max_depth = 0;
 	  break;
+     case OPT_MAX_NODES:
+	  if (parse_number(arg, &p, &max_nodes) || *p || max_nodes == 0)
+	       error(1, 0, _("invalid number of nodes: %s"), arg);
+	  break;
+     case OPT_PARTIAL:
+	  partial_option = 1;
+	  break;
+     case OPT_NO_PARTIAL:
+	  partial_option = 0;
+	  break;
+     case OPT_MERGE:
+	  merge_option = 1;
+	  break;
+     case OPT_NO_MERGE:
+	  merge_option = 0;
+	  break;
+     case OPT_MAX_MEMORY:
+	  if (parse_number(arg, &p, &max_memory))
+	       error(1, 0, _("invalid memory size: %s"), arg);
+	  num = 0;
+	  switch (*p) {
+	  case 'g':
+	  case 'G':
+	       num += 10;
+	       /* FALLTHRU */
+	  case 'm':
+	  case 'M':
+	       num += 10;
+	       /* FALLTHRU */
+	  case 'k':
+	  case 'K':
+	       num += 10;
+	       p++;
+	  }
+	  if (*p || max_memory == 0 || max_memory > ULONG_MAX >> num)
+	       error(1, 0, _("invalid memory size: %s"), arg);
+	  max_memory <<= num;
+	  break;
+     case OPT_ESTIMATE:
+	  estimate_option = 1;
+	  break;
+     case OPT_NO_ESTIMATE:
+	  estimate_option = 0;
+	  break;
      case OPT_DEFINES: /* FIXME: Not used. */
 	  record_defines = 1;
 	  break;
@@ -621,7 +808,15 @@ parse_opt (int key, char *arg, struct argp_state *state)
 	  print_levels = 0;
 	  break;
      case 'm':
-	  start_name = strdup(arg);
+	  start_names = xrealloc(start_names,
+				 (start_name_count + 1) * sizeof(*start_names));
+	  start_names[start_name_count++] = xstrdup(arg);
+	  break;
+     case OPT_AUTO_START:
+	  auto_start_option = 1;
+	  break;
+     case OPT_NO_AUTO_START:
+	  auto_start_option = 0;
 	  break;
      case 'n':
 	  print_line_numbers = 1;
@@ -692,14 +887,12 @@ globals_only()
      return !(symbol_map & SM_STATIC);
 }
 
+/* Decide whether SYM goes to the output, according to symbol_map */
 int
-include_symbol(Symbol *sym)
+select_symbol(Symbol *sym)
 {
      int type = 0;
      
-     if (!sym)
-	  return 0;
-     
      if (sym->type == SymIdentifier) {
 	  if (sym->name[0] == '_' && !(symbol_map & SM_UNDERSCORE))
 	       return 0;
@@ -719,6 +912,39 @@ include_symbol(Symbol *sym)
      return (symbol_map & type) == type;
 }
 
+/* Decide what the parser has to record for the output requested by
+   print_option and symbol_map. The reference lines are printed only
+   in the cross-reference listing, and only for the symbols that are
+   included in it. The caller and callee lists are used only by the
+   trees. The declarations are composed on demand (see symbol_decl),
+   so they need no flag. With --unsorted, the cross-reference lines are
+   printed as soon as they are found instead of being kept. */
+static int
+collection_plan()
+{
+     int plan = 0;
+
+     if ((print_option & PRINT_XREF) && unsorted_option)
+	  plan |= STREAM_XREF;
+     else if (print_option & PRINT_XREF) {
+	  plan |= COLLECT_REFS;
+	  if (symbol_map & SM_UNDERSCORE)
+	       plan |= COLLECT_UNDERSCORE;
+     }
+     if (print_option & PRINT_TREE)
+	  plan |= COLLECT_CALLS;
+     return plan;
+}
+
+/* Compute the `included' bit of all symbols, which is what
+   include_symbol() tests. This must be done once the input has been
+   parsed, and again whenever symbol_map changes. */
+void
+update_inclusion()
+{
+     mark_symbols(select_symbol);
+}
+
 void
 xalloc_die(void)
 {
@@ -767,8 +993,29 @@ main(int argc, char **argv)
 
      if (print_option == 0)
 	  print_option = PRINT_TREE;
+     if (start_name_count == 0) {
+	  static char *default_start_name = "main";
+	  start_names = &default_start_name;
+	  start_name_count = 1;
+     }
+     /* A partial graph records the events, not their results */
+     collect_plan = partial_option ? 0 : collection_plan();
+     if (collect_plan & STREAM_XREF)
+	  open_output();
+
+     if (jobs_option)
+	  lazy_option = 1;
+     if (pipeline_option)
+	  fast_lexer_option = 1;
+     if (lazy_option
+	 && (preprocess_option || reverse_tree || (print_option & PRINT_XREF)))
+	  error(1, 0, _("--lazy and --jobs cannot be used with --cpp, --reverse or --xref"));
+     if (lazy_option && (partial_option || merge_option))
+	  error(1, 0, _("--lazy and --jobs cannot be used with --partial or --merge"));
 
      init();
+     if (partial_option)
+	  begin_partial();
 
      if (arglist) 
 	  /* See comment to cleanup_processor */
@@ -776,6 +1023,8 @@ main(int argc, char **argv)
 	       char *s = (char*)CAR(arglist);
 	       if (s[0] == '-')
 		    pp_option(s);
+	       else if (merge_option)
+		    merge_partial(s);
 	       else if (source(s) == 0)
 		    yyparse();
 	  }
@@ -784,14 +1033,23 @@ main(int argc, char **argv)
      argv += index;
 
      while (argc--) {
-	  if (source(*argv++) == 0)
+	  if (merge_option)
+	       merge_partial(*argv++);
+	  else if (source(*argv++) == 0)
 	       yyparse();
      }
 
      if (input_file_count == 0)
 	     error(1, 0, _("no input files"));
 
+     if (partial_option) {
+	  end_partial();
+	  return 0;
+     }
+     if (lazy_option)
+	  parse_bodies();
      cleanup();
+     update_inclusion();
 
      output();
      return 0;
@@ -18,6 +18,8 @@
 
 #include <cflow.h>
 #include <parser.h>
+#include <limits.h>
+#include <sys/wait.h>
 
 unsigned char *level_mark;
 /* Tree level information. level_mark[i] contains 1 if there are more
@@ -170,25 +172,100 @@ print_symbol (int direct, int level, int last, Symbol *sym)
 }
 
 
+/* Sorting the symbols by name.
+   This is a most significant digit radix sort: the symbols are
+   distributed by the character at the current depth of their names,
+   then each group is sorted by the following characters. Groups that
+   are small enough are finished by insertion sort. The distribution is
+   stable, so symbols with equal names stay in the order they were
+   collected in, as with the merge sort that qsort() usually is. */
+
+#define RADIX_CUTOFF 16
+
+static void
+insertion_sort(Symbol **sym, size_t num, size_t depth)
+{
+     size_t i, j;
+     Symbol *s;
+
+     for (i = 1; i < num; i++) {
+	  s = sym[i];
+	  for (j = i; j > 0 && strcmp(sym[j-1]->name + depth,
+				      s->name + depth) > 0; j--)
+	       sym[j] = sym[j-1];
+	  sym[j] = s;
+     }
+}
+
+static void
+radix_sort(Symbol **sym, Symbol **tmp, size_t num, size_t depth)
+{
+     size_t count[UCHAR_MAX+1];
+     size_t i, pos;
+     int c;
+
+     for (;;) {
+	  if (num < RADIX_CUTOFF) {
+	       insertion_sort(sym, num, depth);
+	       return;
+	  }
+	  memset(count, 0, sizeof count);
+	  for (i = 0; i < num; i++)
+	       count[(unsigned char) sym[i]->name[depth]]++;
+	  /* Names sharing the character at this depth need not be moved */
+	  c = (unsigned char) sym[0]->name[depth];
+	  if (count[c] != num)
+	       break;
+	  if (c == 0)
+	       return;
+	  depth++;
+     }
+     
+     for (c = 0, pos = 0; c <= UCHAR_MAX; c++) {
+	  size_t n = count[c];
+	  count[c] = pos;
+	  pos += n;
+     }
+     for (i = 0; i < num; i++)
+	  tmp[count[(unsigned char) sym[i]->name[depth]]++] = sym[i];
+     memcpy(sym, tmp, num * sizeof(*sym));
+
+     /* count[c] is now the end of the group of c. Group 0 holds the
+	names that end here, which are all equal. */
+     for (c = 1, pos = count[0]; c <= UCHAR_MAX; c++) {
+	  if (count[c] - pos > 1)
+	       radix_sort(sym + pos, tmp, count[c] - pos, depth + 1);
+	  pos = count[c];
+     }
+}
+
+static void
+sort_symbols(Symbol **sym, size_t num)
+{
+     Symbol **tmp;
+
+     if (num < 2)
+	  return;
+     tmp = xmalloc(num * sizeof(*tmp));
+     radix_sort(sym, tmp, num, 0);
+     free(tmp);
+}
+
+/* Can SYMP appear in the cross-reference listing? */
 static int
-compare(const void *ap, const void *bp)
+is_var_type(Symbol *symp)
 {
-     Symbol * const *a = ap;
-     Symbol * const *b = bp;
-     return strcmp((*a)->name, (*b)->name);
+     if (symp->type == SymIdentifier) 
+	  return symp->storage == ExternStorage ||
+	         symp->storage == StaticStorage;
+     else
+	  return 1;
 }
 
 static int
 is_var(Symbol *symp)
 {
-     if (include_symbol(symp)) {
-	  if (symp->type == SymIdentifier) 
-	       return symp->storage == ExternStorage ||
-	 	      symp->storage == StaticStorage;
-	  else
-	       return 1;
-     }
-     return 0;
+     return include_symbol(symp) && is_var_type(symp);
 }
 
 static void
@@ -200,29 +277,33 @@ clear_active(Symbol *sym)
 
 /* Cross-reference output */
 void
-print_refs(char *name, Consptr cons)
+print_refs(char *name, struct ref_list *list)
 {
-     Ref *refptr;
+     Ref ref;
+     size_t pos = 0;
     
-     for ( ; cons; cons = CDR(cons)) {
-	  refptr = (Ref*)CAR(cons);
+     while (next_ref(list, &pos, &ref))
 	  fprintf(outfile, "%s   %s:%d\n",
 		  name,
-		  refptr->source,
-		  refptr->line);
-     }
+		  file_name(ref.source),
+		  ref.line);
+}
+
+static void
+print_definition(Symbol *symp)
+{
+     fprintf(outfile, "%s * %s:%d %s\n",
+	     symp->name,
+	     file_name(symp->source),
+	     symp->def_line,
+	     symbol_decl(symp));
 }
 
 static void
 print_function(Symbol *symp)
 {
-     if (symp->source) {
-	  fprintf(outfile, "%s * %s:%d %s\n",
-		  symp->name,
-		  symp->source,
-		  symp->def_line,
-		  symp->decl);
-     }
+     if (symp->source) 
+	  print_definition(symp);
      print_refs(symp->name, symp->ref_line);
 }
 
@@ -232,10 +313,42 @@ print_type(Symbol *symp)
      if (symp->source)
 	  fprintf(outfile, "%s t %s:%d\n",
 		  symp->name,
-		  symp->source,
+		  file_name(symp->source),
 		  symp->def_line);
 }
    
+/* Unsorted cross-reference output (--unsorted). The lines are printed
+   by the parser as it finds them. Whether a symbol is listed is
+   decided by what is known about it at that moment: e.g. a function
+   whose address is taken before it is called or defined is taken for
+   a data symbol. Temporary symbols are left out, since they are
+   deleted at the end of the source file and never make it to the
+   sorted listing. */
+static int
+is_streamed(Symbol *symp)
+{
+     return symp->flag != symbol_temp
+	    && select_symbol(symp) && is_var_type(symp);
+}
+
+void
+xref_definition(Symbol *symp)
+{
+     if (!is_streamed(symp))
+	  return;
+     if (symp->type == SymIdentifier)
+	  print_definition(symp);
+     else
+	  print_type(symp);
+}
+
+void
+xref_reference(Symbol *symp, int line)
+{
+     if (is_streamed(symp))
+	  fprintf(outfile, "%s   %s:%d\n", symp->name, filename, line);
+}
+
 void
 xref_output()
 {
@@ -243,7 +356,7 @@ xref_output()
      int i, num;
      
      num = collect_symbols(&symbols, is_var);
-     qsort(symbols, num, sizeof(*symbols), compare);
+     sort_symbols(symbols, num);
      
      /* produce xref output */
      for (i = 0; i < num; i++) {
@@ -266,24 +379,354 @@ xref_output()
 
 /* Tree output */
 
-/* Scan call tree. Mark the recursive calls
- */
+/* Walk the strongly connected components of the call graph reachable
+   from the NUM symbols at ROOT (Tarjan's algorithm), so that each
+   symbol and each call is looked at once. The calls are followed from
+   callers to callees if DIRECT is set, and the other way round
+   otherwise. Only the symbols for which FOLLOW returns true are
+   visited. FN is called with the members of each component as soon as
+   the component is complete, so the components a component leads to
+   are always done before it.
+
+   The `active' member of a visited symbol holds its number in the order
+   of visiting, counting from 1. It remains set on return: the visited
+   symbols are stored in *PVISITED, and end_walk() must be called to
+   clear them. Return the number of visited symbols. */
+struct scc_frame {
+     Symbol *sym;
+     unsigned next;          /* Index of the next callee to look at */
+};
+
+static struct symbol_list *
+edges(Symbol *sym, int direct)
+{
+     return direct ? &sym->callee : &sym->caller;
+}
+
+static size_t
+walk_components(Symbol **root, size_t num, int direct,
+		int (*follow)(Symbol *),
+		void (*fn)(Symbol **, size_t, void *), void *data,
+		Symbol ***pvisited)
+{
+     Symbol **visited = NULL;   /* Visited symbols, in order */
+     size_t *low = NULL;        /* Lowest number reachable from each */
+     char *on_stack = NULL;     /* Is it on the component stack? */
+     size_t count = 0, max = 0;
+     Symbol **stack;            /* Component stack */
+     size_t sp = 0;
+     struct scc_frame *frame;   /* Depth-first search stack */
+     size_t fp = 0;
+     size_t i, v, w;
+     Symbol *sym;
+     struct symbol_list *list;
+
+     stack = NULL;
+     frame = NULL;
+     for (i = 0; i < num; i++) {
+	  if (!follow(root[i]) || root[i]->active)
+	       continue;
+	  sym = root[i];
+	  for (;;) {
+	       if (sym) {
+		    /* Visit SYM */
+		    if (count == max) {
+			 max = max ? 2 * max : 256;
+			 visited = xrealloc(visited, max * sizeof(*visited));
+			 low = xrealloc(low, max * sizeof(*low));
+			 on_stack = xrealloc(on_stack, max);
+			 stack = xrealloc(stack, max * sizeof(*stack));
+			 frame = xrealloc(frame, max * sizeof(*frame));
+		    }
+		    visited[count] = sym;
+		    low[count] = count;
+		    on_stack[count] = 1;
+		    sym->active = ++count;
+		    stack[sp++] = sym;
+		    frame[fp].sym = sym;
+		    frame[fp].next = 0;
+		    fp++;
+		    sym = NULL;
+	       }
+	       if (fp == 0)
+		    break;
+	       
+	       v = frame[fp-1].sym->active - 1;
+	       list = edges(visited[v], direct);
+	       if (frame[fp-1].next < list->count) {
+		    Symbol *callee = SYMBOL_LIST_PTR(list)[frame[fp-1].next++];
+		    if (!follow(callee))
+			 continue;
+		    if (!callee->active)
+			 sym = callee;
+		    else {
+			 w = callee->active - 1;
+			 if (on_stack[w] && w < low[v])
+			      low[v] = w;
+		    }
+		    continue;
+	       }
+
+	       /* All callees of V are done */
+	       fp--;
+	       if (fp) {
+		    w = frame[fp-1].sym->active - 1;
+		    if (low[v] < low[w])
+			 low[w] = low[v];
+	       }
+	       if (low[v] == v) {
+		    /* V is the root of a component */
+		    size_t n = 0;
+		    do {
+			 w = stack[--sp]->active - 1;
+			 on_stack[w] = 0;
+			 n++;
+		    } while (w != v);
+		    fn(stack + sp, n, data);
+	       }
+	  }
+     }
+
+     free(low);
+     free(on_stack);
+     free(stack);
+     free(frame);
+     *pvisited = visited;
+     return count;
+}
+
 static void
-scan_tree(int lev, Symbol *sym)
+end_walk(Symbol **visited, size_t count)
 {
-     Consptr cons;
+     size_t i;
 
-     if (sym->type == SymUndefined)
-	  return;
-     if (sym->active) {
-	  sym->recursive = 1;
-	  return;
+     for (i = 0; i < count; i++)
+	  visited[i]->active = 0;
+     free(visited);
+}
+
+static int
+is_defined(Symbol *sym)
+{
+     return sym->type != SymUndefined;
+}
+
+/* A function is recursive if it lies on a cycle of calls, i.e. if it
+   calls itself or belongs to a component of several functions */
+static void
+mark_component(Symbol **member, size_t n, void *data)
+{
+     struct symbol_list *list;
+     unsigned i;
+     
+     if (n == 1) {
+	  list = &member[0]->callee;
+	  for (i = 0; i < list->count; i++)
+	       if (SYMBOL_LIST_PTR(list)[i] == member[0]) {
+		    member[0]->recursive = 1;
+		    break;
+	       }
+     } else
+	  while (n--)
+	       member[n]->recursive = 1;
+}
+
+/* Mark the recursive functions reachable from the NUM symbols at ROOT. */
+static void
+mark_recursive(Symbol **root, size_t num)
+{
+     Symbol **visited;
+     size_t count;
+
+     count = walk_components(root, num, 1, is_defined,
+			     mark_component, NULL, &visited);
+     end_walk(visited, count);
+}
+
+
+/* Estimating the size of the output.
+   Without --brief, a tree shows the whole subtree of a function each
+   time the function appears, so its size may grow exponentially with
+   the depth of the call graph. The sizes are found by summing them up
+   over the components of the graph, callees first. A function out of
+   any cycle has exactly one line plus the lines of the trees of its
+   callees. The functions of a cycle get one line for entering the
+   cycle, one for each call within it and the lines of the trees of the
+   functions called from the cycle. This is exact for the simple cycles,
+   and a lower bound otherwise, because the trees below a cycle can
+   repeat some of its members. The --depth limit is not taken into
+   account. */
+struct estimate {
+     int direct;
+     unsigned long *size;     /* Tree sizes, by the number of visiting */
+     size_t *comp;            /* Component numbers, likewise */
+     size_t max;              /* Size of the arrays */
+     size_t ncomp;            /* Number of components done */
+};
+
+static int
+is_printable_symbol(Symbol *sym)
+{
+     return sym->type != SymUndefined && include_symbol(sym);
+}
+
+/* Add two node counts, saturating at ULONG_MAX */
+static unsigned long
+add_nodes(unsigned long a, unsigned long b)
+{
+     return a > ULONG_MAX - b ? ULONG_MAX : a + b;
+}
+
+static void
+estimate_component(Symbol **member, size_t n, void *data)
+{
+     struct estimate *est = data;
+     struct symbol_list *list;
+     Symbol *sym;
+     unsigned long total = 1;
+     size_t i, k;
+     unsigned j;
+
+     est->ncomp++;
+     for (i = 0; i < n; i++) {
+	  k = member[i]->active - 1;
+	  if (k >= est->max) {
+	       while (k >= est->max)
+		    est->max = est->max ? 2 * est->max : 256;
+	       est->size = xrealloc(est->size, est->max * sizeof(*est->size));
+	       est->comp = xrealloc(est->comp, est->max * sizeof(*est->comp));
+	  }
+	  est->comp[k] = est->ncomp;
+     }
+     for (i = 0; i < n; i++) {
+	  list = edges(member[i], est->direct);
+	  for (j = 0; j < list->count; j++) {
+	       sym = SYMBOL_LIST_PTR(list)[j];
+	       if (!is_printable_symbol(sym))
+		    continue;
+	       k = sym->active - 1;
+	       total = add_nodes(total,
+				 est->comp[k] == est->ncomp ? 1 : est->size[k]);
+	  }
+     }
+     for (i = 0; i < n; i++)
+	  est->size[member[i]->active - 1] = total;
+}
+
+/* Estimate the number of nodes in the trees starting at the NUM symbols
+   at ROOT. With --estimate, print them. Otherwise, warn if the output
+   is going to be cut off by --max-nodes. */
+static void
+estimate_output(Symbol **root, size_t num, int direct)
+{
+     struct estimate est;
+     Symbol **visited;
+     size_t i, count;
+     unsigned long size, total = 0;
+     
+     memset(&est, 0, sizeof est);
+     est.direct = direct;
+     count = walk_components(root, num, direct, is_printable_symbol,
+			     estimate_component, &est, &visited);
+     for (i = 0; i < num; i++) {
+	  if (!is_printable_symbol(root[i]))
+	       continue;
+	  size = est.size[root[i]->active - 1];
+	  if (estimate_option)
+	       fprintf(outfile, "%s: %lu\n", root[i]->name, size);
+	  total = add_nodes(total, size);
+     }
+     if (!estimate_option && total > max_nodes)
+	  error(0, 0,
+		_("the graph has at least %lu nodes, printing only %lu of them"),
+		total, max_nodes);
+     end_walk(visited, count);
+     free(est.size);
+     free(est.comp);
+}
+
+/* Automatic selection of start symbols (--auto-start) */
+
+/* Is SYM called by any printable function other than itself? */
+static int
+is_called(Symbol *sym)
+{
+     Symbol **caller = SYMBOL_LIST_PTR(&sym->caller);
+     unsigned i;
+
+     for (i = 0; i < sym->caller.count; i++)
+	  if (caller[i] != sym
+	      && caller[i]->type != SymUndefined
+	      && include_symbol(caller[i]))
+	       return 1;
+     return 0;
+}
+
+struct reached {
+     Symbol **sym;
+     size_t count;
+     size_t max;
+};
+
+static void
+add_reached(struct reached *r, Symbol *sym)
+{
+     if (r->count == r->max) {
+	  r->max = r->max ? 2 * r->max : 256;
+	  r->sym = xrealloc(r->sym, r->max * sizeof(*r->sym));
      }
      sym->active = 1;
-     for (cons = sym->callee; cons; cons = CDR(cons)) {
-	  scan_tree(lev+1, (Symbol*)CAR(cons));
+     r->sym[r->count++] = sym;
+}
+
+/* Add to R the symbols the tree starting at SYM shows, going breadth
+   first. The `active' member of the symbols in R is set. */
+static void
+reach(struct reached *r, Symbol *sym)
+{
+     size_t head = r->count;
+     Symbol **callee;
+     unsigned i;
+
+     if (sym->active)
+	  return;
+     add_reached(r, sym);
+     for (; head < r->count; head++) {
+	  sym = r->sym[head];
+	  callee = SYMBOL_LIST_PTR(&sym->callee);
+	  for (i = 0; i < sym->callee.count; i++)
+	       if (!callee[i]->active
+		   && callee[i]->type != SymUndefined
+		   && include_symbol(callee[i]))
+		    add_reached(r, callee[i]);
      }
-     sym->active = 0;
+}
+
+/* Select the start symbols among the NUM sorted symbols at SYMBOLS,
+   storing them in ROOT. These are the functions no other function
+   calls, followed by one function from each cycle of calls that is not
+   reachable from them. Return the number of start symbols. */
+static size_t
+auto_start(Symbol **symbols, size_t num, Symbol **root)
+{
+     struct reached r;
+     size_t i, nroot = 0;
+
+     memset(&r, 0, sizeof r);
+     for (i = 0; i < num; i++)
+	  if (symbols[i]->callee.count && !is_called(symbols[i])) {
+	       root[nroot++] = symbols[i];
+	       reach(&r, symbols[i]);
+	  }
+     for (i = 0; i < num; i++)
+	  if (symbols[i]->callee.count && !symbols[i]->active) {
+	       root[nroot++] = symbols[i];
+	       reach(&r, symbols[i]);
+	  }
+     for (i = 0; i < r.count; i++)
+	  r.sym[i]->active = 0;
+     free(r.sym);
+     return nroot;
 }
 
 static void
@@ -292,32 +735,58 @@ set_active(Symbol *sym)
      sym->active = out_line;
 }
 
+/* Is the Ith element of LIST printable? */
 static int
-is_printable(Consptr cons)
+is_printable(struct symbol_list *list, unsigned i)
 {
-     return cons != NULL && include_symbol((Symbol*)CAR(cons));
+     return i < list->count && include_symbol(SYMBOL_LIST_PTR(list)[i]);
 }
 
+/* Is the Ith element of LIST the last printable one? */
 static int
-is_last(Consptr cons)
+is_last(struct symbol_list *list, unsigned i)
 {
-     while (cons = CDR(cons)) 
-	  if (is_printable(cons))
+     while (++i < list->count) 
+	  if (is_printable(list, i))
 	       return 0;
      return 1;
 }
 
+/* Count a node about to be output. Return 0 if it may be output, and
+   1 if the --max-nodes limit has been reached. The output is marked as
+   truncated when this happens for the first time. */
+static unsigned long node_count;
+static int truncated;
+
+static int
+count_node()
+{
+     if (!max_nodes)
+	  return 0;
+     if (node_count == max_nodes) {
+	  if (!truncated) {
+	       print_text(_("... (output truncated at the --max-nodes limit)"));
+	       newline();
+	       truncated = 1;
+	  }
+	  return 1;
+     }
+     node_count++;
+     return 0;
+}
+
 /* Produce direct call tree output
  */
 static void
 direct_tree(int lev, int last, Symbol *sym)
 {
-     Consptr cons;
+     unsigned i;
      int rc;
      
      if (sym->type == SymUndefined
 	 || (max_depth && lev >= max_depth)
-	 || !include_symbol(sym))
+	 || !include_symbol(sym)
+	 || count_node())
 	  return;
 
      rc = print_symbol(1, lev, last, sym);
@@ -325,9 +794,10 @@ direct_tree(int lev, int last, Symbol *sym)
      if (rc || sym->active)
 	  return;
      set_active(sym);
-     for (cons = sym->callee; cons; cons = CDR(cons)) {
-	  set_level_mark(lev+1, is_printable(CDR(cons)));
-	  direct_tree(lev+1, is_last(cons), (Symbol*)CAR(cons));
+     for (i = 0; i < sym->callee.count; i++) {
+	  set_level_mark(lev+1, is_printable(&sym->callee, i+1));
+	  direct_tree(lev+1, is_last(&sym->callee, i),
+		     SYMBOL_LIST_PTR(&sym->callee)[i]);
      }
      clear_active(sym);
 }
@@ -337,71 +807,234 @@ direct_tree(int lev, int last, Symbol *sym)
 static void
 inverted_tree(int lev, int last, Symbol *sym)
 {
-     Consptr cons;
+     unsigned i;
      int rc;
      
      if (sym->type == SymUndefined
 	 || (max_depth && lev >= max_depth)
-	 || !include_symbol(sym))
+	 || !include_symbol(sym)
+	 || count_node())
 	  return;
      rc = print_symbol(0, lev, last, sym);
      newline();
      if (rc || sym->active)
 	  return;
      set_active(sym);
-     for (cons = sym->caller; cons; cons = CDR(cons)) {
-	  set_level_mark(lev+1, is_printable(CDR(cons)));
-	  inverted_tree(lev+1, is_last(cons), (Symbol*)CAR(cons));
+     for (i = 0; i < sym->caller.count; i++) {
+	  set_level_mark(lev+1, is_printable(&sym->caller, i+1));
+	  inverted_tree(lev+1, is_last(&sym->caller, i),
+		     SYMBOL_LIST_PTR(&sym->caller)[i]);
      }
      clear_active(sym);
 }
 
+/* Output the trees starting at the NUM symbols at ROOT */
+static void
+output_trees(Symbol **root, size_t num)
+{
+     size_t i;
+     
+     for (i = 0; i < num && !truncated; i++) {
+	  if (reverse_tree)
+	       inverted_tree(0, 0, root[i]);
+	  else
+	       direct_tree(0, 0, root[i]);
+	  separator();
+     }
+}
+
+
+/* Parallel output (--output-jobs).
+   Without --brief, the tree of a start symbol does not depend on the
+   trees output before it, except for the line numbers it shows. So the
+   lines of each tree are counted first, and the trees are split into
+   runs of about the same number of lines. The start line of each run
+   is the sum of the lines before it. The runs are output by child
+   processes into temporary files, which are then copied to the output
+   in order. The result is the same as that of output_trees(). */
+
+#define PARALLEL_MIN_LINES 4096  /* Smaller outputs are not worth it */
+
+struct output_run {
+     pid_t pid;          /* Child process outputting the run */
+     FILE *fp;           /* Its output */
+     size_t first;       /* Index of its first tree */
+     size_t count;       /* Number of trees in it */
+     int line;           /* Line it starts at */
+};
+
+/* Count the lines direct_tree() or inverted_tree() would output for
+   SYM at level LEV */
+static unsigned long
+count_lines(int lev, Symbol *sym, int direct)
+{
+     struct symbol_list *list;
+     unsigned long n;
+     unsigned i;
+     
+     if (sym->type == SymUndefined
+	 || (max_depth && lev >= max_depth)
+	 || !include_symbol(sym))
+	  return 0;
+     if (sym->active)
+	  return 1;
+     sym->active = 1;
+     n = 1;
+     list = edges(sym, direct);
+     for (i = 0; i < list->count; i++)
+	  n = add_nodes(n, count_lines(lev+1, SYMBOL_LIST_PTR(list)[i], direct));
+     sym->active = 0;
+     return n;
+}
+
+/* Start a child process outputting the run RP. */
+static pid_t
+fork_output(Symbol **root, struct output_run *rp)
+{
+     pid_t pid;
+
+     pid = fork();
+     if (pid == 0) {
+	  outfile = rp->fp;
+	  out_line = rp->line;
+	  output_trees(root + rp->first, rp->count);
+	  _exit(fflush(outfile) || ferror(outfile));
+     }
+     return pid;
+}
+
+/* Copy the output of the run RP to outfile. Return 0 on success. */
+static int
+copy_run(struct output_run *rp)
+{
+     static char buf[65536];
+     size_t n;
+     int status;
+
+     if (waitpid(rp->pid, &status, 0) != rp->pid
+	 || !WIFEXITED(status) || WEXITSTATUS(status))
+	  return 1;
+     rewind(rp->fp);
+     while ((n = fread(buf, 1, sizeof buf, rp->fp)) > 0)
+	  fwrite(buf, 1, n, outfile);
+     return 0;
+}
+
+/* Output the trees starting at the NUM symbols at ROOT in parallel.
+   Return 0 if they have been output, and 1 if this is not possible or
+   not worth it. */
+static int
+output_parallel(Symbol **root, size_t num)
+{
+     struct output_run *runs;
+     unsigned long *lines, total, part, sum;
+     size_t i;
+     int k, nruns, line;
+     
+     if (output_jobs_option < 2 || brief_listing || max_nodes || num < 2)
+	  return 1;
+     lines = xcalloc(num, sizeof(*lines));
+     for (i = 0, total = 0; i < num; i++) {
+	  lines[i] = count_lines(0, root[i], !reverse_tree);
+	  total = add_nodes(total, lines[i]);
+     }
+     if (total < PARALLEL_MIN_LINES || total > INT_MAX - out_line) {
+	  free(lines);
+	  return 1;
+     }
+
+     runs = xcalloc(output_jobs_option, sizeof(*runs));
+     part = (total + output_jobs_option - 1) / output_jobs_option;
+     line = out_line;
+     for (nruns = 0, i = 0; i < num; nruns++) {
+	  runs[nruns].first = i;
+	  runs[nruns].line = line;
+	  sum = 0;
+	  do
+	       sum += lines[i++];
+	  while (i < num && (sum < part || nruns == output_jobs_option - 1));
+	  runs[nruns].count = i - runs[nruns].first;
+	  line += sum;
+     }
+     free(lines);
+
+     fflush(NULL);
+     for (k = 0; k < nruns; k++) {
+	  runs[k].fp = tmpfile();
+	  runs[k].pid = runs[k].fp ? fork_output(root, &runs[k]) : -1;
+     }
+     
+     /* Copy the runs in order. A run whose child could not be started
+	or failed is output here. */
+     for (k = 0; k < nruns; k++) {
+	  if (runs[k].pid == -1 || copy_run(&runs[k])) {
+	       out_line = runs[k].line;
+	       output_trees(root + runs[k].first, runs[k].count);
+	  }
+	  if (runs[k].fp)
+	       fclose(runs[k].fp);
+     }
+     out_line = line;
+     free(runs);
+     return 0;
+}
+
 static void
 tree_output()
 {
-     Symbol **symbols, *main_sym;
-     int i, num;
+     Symbol **symbols, **root;
+     size_t i, num, nroot = 0;
      
      /* Collect and sort symbols */
      num = collect_symbols(&symbols, is_var);
-     qsort(symbols, num, sizeof(*symbols), compare);
-     /* Scan and mark the recursive ones */
-     for (i = 0; i < num; i++) {
-	  if (symbols[i]->callee)
-	       scan_tree(0, symbols[i]);
+     sort_symbols(symbols, num);
+
+     /* Select the start symbols */
+     if (reverse_tree) {
+	  root = symbols;
+	  nroot = num;
+     } else {
+	  root = xcalloc(num + start_name_count, sizeof(*root));
+	  if (auto_start_option) 
+	       nroot = auto_start(symbols, num, root);
+	  else {
+	       for (i = 0; i < start_name_count; i++) {
+		    Symbol *sym = lookup(start_names[i]);
+		    if (sym)
+			 root[nroot++] = sym;
+	       }
+	       if (nroot == 0) {
+		    for (i = 0; i < num; i++)
+			 if (symbols[i]->callee.count)
+			      root[nroot++] = symbols[i];
+	       }
+	  }
      }
-     
-     /* Produce output */
-    begin();
-    
-    if (reverse_tree) {
-	 for (i = 0; i < num; i++) {
-	      inverted_tree(0, 0, symbols[i]);
-	      separator();
-	 }
-    } else {
-	 main_sym = lookup(start_name);
-	 if (main_sym) {
-	      direct_tree(0, 0, main_sym);
-	      separator();
-	 } else {
-	      for (i = 0; i < num; i++) {
-		   if (symbols[i]->callee == NULL)
-			continue;
-		   direct_tree(0, 0, symbols[i]);
-		   separator();
-	      }
-	 }
-    }
-    
-    end();
-    
-    free(symbols);
+     if (estimate_option) {
+	  estimate_output(root, nroot, !reverse_tree);
+     } else {
+	  mark_recursive(root, nroot);
+	  if (max_nodes && !brief_listing)
+	       estimate_output(root, nroot, !reverse_tree);
+
+	  /* Produce output */
+	  begin();
+	  if (output_parallel(root, nroot))
+	       output_trees(root, nroot);
+	  end();
+     }
+
+     if (root != symbols)
+	  free(root);
+     free(symbols);
 }
 
+/* Open the output file, unless it is already open */
 void
-output()
+open_output()
 {
+     if (outfile)
+	  return;
      if (strcmp(outname, "-") == 0) {
 	  outfile = stdout;
      } else {
@@ -409,10 +1042,15 @@ output()
 	  if (!outfile)
 	       error(2, errno, _("cannot open file `%s'"), outname);
      } 
-     
+}
+
+void
+output()
+{
+     open_output();
      level_mark = xmalloc(level_mark_size);
      set_level_mark(0, 0);
-     if (print_option & PRINT_XREF) {
+     if ((print_option & PRINT_XREF) && !(collect_plan & STREAM_XREF)) {
 	  xref_output();
      }
      if (print_option & PRINT_TREE) {
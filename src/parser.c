@@ -18,9 +18,14 @@
 
 #include <cflow.h>
 #include <parser.h>
+#include <hash.h>
+#include <sys/wait.h>
+#include <signal.h>
 
 typedef struct {
-     char *name;
+     char *name;       /* Points into the input buffer, see YYSTYPE */
+     int len;
+     unsigned hash;
      int type_end;
      int parmcnt;
      int line;
@@ -31,32 +36,50 @@ void parse_declaration(Ident*, int);
 void parse_variable_declaration(Ident*, int);
 void parse_function_declaration(Ident*, int);
 void parse_dcl(Ident*);
+void parse_dcl_at(Ident*);
+void next_dcl(int, int);
 void parse_knr_dcl(Ident*);
 void parse_typedef();
 void expression();
 void initializer_list();
 void func_body();
+void begin_unit();
+void defer_body(Symbol *);
 void declare(Ident*);
 void declare_type(Ident*);
+static void define_symbol(Symbol*, Ident*, char*);
+static void log_caller(Ident*);
+static void leave_block(int level);
+static void leave_parms(int level);
+static void enter_body(int level);
+static void declare_auto(Ident *ident, int parm, int lev);
+static void begin_partial_unit(void);
+static void end_partial_unit(void);
+static void log_partial_declare(Ident *ident);
 int dcl(Ident*);
 int parmdcl(Ident*);
 int dirdcl(Ident*);
 void skip_struct();
-Symbol *get_symbol(char *name);
+Symbol *get_symbol(char *name, int len, unsigned hash);
 void maybe_parm_list(int *parm_cnt_return);
     
-void call(char*, int);
-void reference(char*, int);
+Symbol *call(char*, int, unsigned, int);
+Symbol *reference(char*, int, unsigned, int);
 
 int level;                  /* Current nesting level */
 Symbol *caller;             /* Current caller */
 struct obstack text_stk;    /* Obstack for composing declaration line */
+static struct obstack decl_stk; /* Pending declarations of the current
+				   source file */
+static struct pending_decl *pending_decls;
 
 int parm_level;             /* Parameter declaration nesting level */
 
 typedef struct {
      int type;
-     char *token;
+     char *token;      /* Text of the token, see YYSTYPE */
+     int len;          /* and its length */
+     unsigned hash;    /* Hash value of an identifier */
      int line;
 } TOKSTK;
 
@@ -72,9 +95,39 @@ static int need_space;
 
 void mark(Stackpos);
 void restore(Stackpos);
-void tokpush(int,int,char*);
+void tokpush(int,int,char*,int,unsigned);
 void save_token(TOKSTK *);
 
+/* Memoized lookahead over the leading part of a declaration.
+ * is_function() scans it once, recording both its own verdict and
+ * the state in which the prefix loop of dcl() would leave the token
+ * stack. A subsequent dcl() starting at the same stack position picks
+ * that state up instead of classifying the same tokens again.
+ * The record is valid as long as none of the stack positions from
+ * START to END has been rewritten.
+ */
+struct lookahead {
+     int start;              /* Stack position of the first token */
+     int end;                /* Last stack position examined */
+     int type_end;           /* First MODIFIER seen by dcl(), or -1 */
+     int curs;               /* Value of curs on exit from dcl() loop */
+     TOKSTK tok;             /* Value of tok on exit from dcl() loop */
+};
+
+static struct lookahead lookahead = { -1 };
+
+static void
+forget_lookahead()
+{
+     lookahead.start = -1;
+}
+
+static int
+lookahead_valid(int pos)
+{
+     return lookahead.start == pos && lookahead.end < tos;
+}
+
 static void
 print_token(TOKSTK *tokptr)
 {
@@ -84,7 +137,7 @@ print_token(TOKSTK *tokptr)
      case WORD:
      case MODIFIER:
      case STRUCT:
-	  fprintf(stderr, "`%s'", tokptr->token);
+	  fprintf(stderr, "`%.*s'", tokptr->len, tokptr->token);
 	  break;
      case LBRACE0:
      case LBRACE:
@@ -137,10 +190,14 @@ restore(Stackpos pos)
 }
 
 void
-tokpush(int type, int line, char *token)
+tokpush(int type, int line, char *token, int len, unsigned hash)
 {
+     if (tos <= lookahead.end)
+	  forget_lookahead();
      token_stack[tos].type = type;
      token_stack[tos].token = token;
+     token_stack[tos].len = len;
+     token_stack[tos].hash = hash;
      token_stack[tos].line = line;
      if (++tos == token_stack_length) {
 	  token_stack_length += token_stack_increase;
@@ -159,12 +216,14 @@ cleanup_stack()
 
      tos = delta;
      curs = 0;
+     forget_lookahead();
 }
 
 void
 clearstack()
 {
      tos = curs = 0;
+     forget_lookahead();
 }
 
 int
@@ -174,7 +233,7 @@ nexttoken()
      
      if (curs == tos) {
 	  type = get_token();
-	  tokpush(type, line_num, yylval.str);
+	  tokpush(type, line_num, yylval.str, yylval.len, yylval.hash);
      }
      tok = token_stack[curs];
      curs++;
@@ -190,6 +249,8 @@ putback()
      if (curs > 0) {
 	  tok.type = token_stack[curs-1].type;
 	  tok.token = token_stack[curs-1].token;
+	  tok.len = token_stack[curs-1].len;
+	  tok.hash = token_stack[curs-1].hash;
      } else
 	  tok.type = 0;
      return tok.type;
@@ -199,6 +260,7 @@ void
 init_parse()
 {
      obstack_init(&text_stk);
+     obstack_init(&decl_stk);
      token_stack = xmalloc(token_stack_length*sizeof(*token_stack));
      clearstack();
 }
@@ -206,8 +268,6 @@ init_parse()
 void
 save_token(TOKSTK *tokptr)
 {
-     int len;
-    
      switch (tokptr->type) {
      case IDENTIFIER:
      case TYPE:
@@ -216,8 +276,7 @@ save_token(TOKSTK *tokptr)
      case WORD:
 	  if (need_space) 
 	       obstack_1grow(&text_stk, ' ');
-	  len = strlen(tokptr->token);
-	  obstack_grow(&text_stk, tokptr->token, len);
+	  obstack_grow(&text_stk, tokptr->token, tokptr->len);
 	  need_space = 1;
 	  break;
      case MODIFIER:
@@ -227,8 +286,7 @@ save_token(TOKSTK *tokptr)
 	       need_space = 0;
 	  else
 	       need_space = 1;
-	  len = strlen(tokptr->token);
-	  obstack_grow(&text_stk, tokptr->token, len);
+	  obstack_grow(&text_stk, tokptr->token, tokptr->len);
 	  break;
      case EXTERN: /* storage class specifiers are already taken care of */
      case STATIC:
@@ -259,20 +317,21 @@ undo_save_stack()
      save_end = -1;
 }
 
-char *
-finish_save_stack(char *name)
+/* Compose the declaration of NAME from the COUNT tokens at STK */
+static char *
+compose_decl(TOKSTK *stk, int count, char *name, int len)
 {
      int i;
      int level = 0;
      int found_ident = !omit_symbol_names_option;
 
      need_space = 0;
-     for (i = 0; i < save_end ; i++) {
-	  switch (token_stack[i].type) {
+     for (i = 0; i < count; i++) {
+	  switch (stk[i].type) {
 	  case '(':
 	       if (omit_arguments_option) {
 		    if (level == 0) {
-			 save_token(token_stack+i);
+			 save_token(stk+i);
 		    }
 		    level++;
 	       }
@@ -282,19 +341,78 @@ finish_save_stack(char *name)
 		    level--;
 	       break;
 	  case IDENTIFIER:
-	       if (!found_ident && strcmp (name, token_stack[i].token) == 0) {
+	       if (!found_ident
+		   && stk[i].len == len
+		   && memcmp(name, stk[i].token, len) == 0) {
 		    need_space = 1;
 		    found_ident = 1;
 		    continue;
 	       }
 	  }
 	  if (level == 0)
-	       save_token(token_stack+i);
+	       save_token(stk+i);
      }
      obstack_1grow(&text_stk, 0);
      return obstack_finish(&text_stk);
 }
 
+/* Make the saved tokens the declaration of SP. Only the tokens are
+   copied here: the text is composed by symbol_decl() when it is
+   first asked for, which for most symbols is never. */
+static void
+save_decl(Symbol *sp)
+{
+     int count = save_end > 0 ? save_end : 0;
+     struct pending_decl *pd;
+
+     pd = obstack_alloc(&decl_stk, sizeof(*pd) + count * sizeof(TOKSTK));
+     pd->owner = sp;
+     pd->next = pending_decls;
+     pd->count = count;
+     memcpy(pd + 1, token_stack, count * sizeof(TOKSTK));
+     pending_decls = pd;
+     sp->decl.pending = pd;
+     sp->decl_pending = 1;
+}
+
+/* Return the declaration text of SP, or NULL if it has none */
+char *
+symbol_decl(Symbol *sp)
+{
+     if (sp->decl_pending) {
+	  struct pending_decl *pd = sp->decl.pending;
+	  sp->decl.text = compose_decl((TOKSTK *) (pd + 1), pd->count,
+				       sp->name, sp->len);
+	  sp->decl_pending = 0;
+     }
+     return sp->decl.text;
+}
+
+/* The saved tokens point into the input buffer. Compose the pending
+   declarations of the symbols still alive before the buffer is
+   reused, and forget the rest. */
+void
+finish_decls()
+{
+     struct pending_decl *pd, *first = NULL;
+     Symbol *sp;
+
+     for (pd = pending_decls; pd; pd = pd->next) {
+	  sp = pd->owner;
+	  if (sp->decl_pending && sp->decl.pending == pd) {
+	       if (sp->type == SymUndefined) {
+		    sp->decl_pending = 0;
+		    sp->decl.text = NULL;
+	       } else
+		    symbol_decl(sp);
+	  }
+	  first = pd;
+     }
+     if (first)
+	  obstack_free(&decl_stk, first);
+     pending_decls = NULL;
+}
+
 void
 skip_to(int c)
 {
@@ -312,6 +430,10 @@ yyparse()
      level = 0;
      caller = NULL;
      clearstack();
+     if (lazy_option)
+	  begin_unit();
+     if (partial_option)
+	  begin_partial_unit();
      while (nexttoken()) {
 	  identifier.storage = ExternStorage;
 	  switch (tok.type) {
@@ -334,27 +456,113 @@ yyparse()
 	  }
 	  cleanup_stack();
      }
-     /*NOTREACHED*/
+     if (partial_option)
+	  end_partial_unit();
+     return 0;
 }
 
+/* Return the token at stack position POS, reading it in if necessary.
+   Positions must be requested in ascending order. */
+static int
+token_at(int pos)
+{
+     int type;
+     
+     if (pos == tos) {
+	  type = get_token();
+	  tokpush(type, line_num, yylval.str, yylval.len, yylval.hash);
+     }
+     return token_stack[pos].type;
+}
+
+/* Record the exit state of the dcl() prefix loop for a loop that
+   left CURS_POS in curs. If PUTBACK is set, the loop had read one token
+   too many and returned it with putback(). */
+static void
+lookahead_exit(int curs_pos, int putback)
+{
+     lookahead.curs = curs_pos;
+     if (putback) {
+	  lookahead.tok = token_stack[curs_pos];
+	  if (curs_pos > 0) {
+	       lookahead.tok.type = token_stack[curs_pos-1].type;
+	       lookahead.tok.token = token_stack[curs_pos-1].token;
+	       lookahead.tok.len = token_stack[curs_pos-1].len;
+	       lookahead.tok.hash = token_stack[curs_pos-1].hash;
+	  } else
+	       lookahead.tok.type = 0;
+     } else 
+	  lookahead.tok = token_stack[curs_pos-1];
+}
+
+/* Decide whether the declaration starting at the current token declares
+   a function. Each token is classified once: the same pass simulates
+   the prefix loop of dcl() and memoizes its result (see struct
+   lookahead above). The pass never reads further than the function
+   test itself needs, so the lexer is not run ahead of the parser. */
 static int
 is_function()
 {
      Stackpos sp;
+     int pos, type;
+     int in_dcl = 1, in_fn = 1;
      int res = 0;
 
      mark(sp);
-/*    if (tok.type == STRUCT)
-	nexttoken();*/
-     while (tok.type == TYPE ||
-	    tok.type == IDENTIFIER ||
-	    tok.type == MODIFIER ||
-	    tok.type == STATIC ||
-	    tok.type == EXTERN)
-	  nexttoken();
+     pos = curs - 1;
+     lookahead.start = pos;
+     lookahead.type_end = -1;
+     while (in_fn) {
+	  type = token_at(pos);
+	  if (type == IDENTIFIER) {
+	       /* Both loops pass over a run of identifiers. dcl() looks
+		  at the token that follows it to decide whether the last
+		  identifier is the declarator name */
+	       while ((type = token_at(++pos)) == IDENTIFIER)
+		    ;
+	       if (in_dcl && type != TYPE && type != MODIFIER) {
+		    lookahead_exit(pos, 1);
+		    in_dcl = 0;
+	       }
+	       continue;
+	  }
+	  
+	  if (in_dcl) {
+	       switch (type) {
+	       case 0:
+	       case '(':
+		    lookahead_exit(pos + 1, 0);
+		    in_dcl = 0;
+		    break;
+	       case ')':
+		    lookahead_exit(pos, 1);
+		    in_dcl = 0;
+		    break;
+	       case MODIFIER:
+		    if (lookahead.type_end == -1)
+			 lookahead.type_end = pos;
+	       }
+	  }
+
+	  switch (type) {
+	  case TYPE:
+	  case MODIFIER:
+	  case STATIC:
+	  case EXTERN:
+	       break;
+	  case '(':
+	       res = token_at(pos + 1) != MODIFIER;
+	       /* FALLTHRU */
+	  default:
+	       in_fn = 0;
+	  }
+	  pos++;
+     }
      
-     if (tok.type == '(') 
-	  res = nexttoken() != MODIFIER;
+     if (in_dcl)
+	  forget_lookahead();
+     else
+	  lookahead.end = tos - 1;
      
      restore(sp);
      return res;
@@ -367,7 +575,7 @@ parse_declaration(Ident *ident, int parm)
 	  parse_function_declaration(ident, parm);
      else
 	  parse_variable_declaration(ident, parm);
-     delete_parms(parm_level);
+     leave_parms(parm_level);
 }
 
 
@@ -375,6 +583,8 @@ void
 expression()
 {
      char *name;
+     int len;
+     unsigned hash;
      int line;
      int parens_lev;
 
@@ -400,13 +610,15 @@ expression()
 	    
 	  case IDENTIFIER:
 	       name = tok.token;
+	       len = tok.len;
+	       hash = tok.hash;
 	       line = tok.line;
 	       nexttoken();
 	       if (tok.type == '(') {
-		    call(name, line);
+		    call(name, len, hash, line);
 		    parens_lev++;
 	       } else {
-		    reference(name, line);
+		    reference(name, len, hash, line);
 		    if (tok.type == MEMBER_OF) {
 			 while (tok.type == MEMBER_OF)
 			      nexttoken();
@@ -461,8 +673,12 @@ parse_function_declaration(Ident *ident, int parm)
      case LBRACE0:
      case LBRACE:
 	  if (ident->name) {
-	       caller = lookup(ident->name);
-	       func_body();
+	       caller = lookup_hashed(ident->name, ident->len, ident->hash);
+	       log_caller(ident);
+	       if (lazy_option && level == 0 && caller && curs == tos)
+		    defer_body(caller);
+	       else
+		    func_body();
 	  }
 	  break;
      case 0:
@@ -489,14 +705,17 @@ fake_struct(Ident *ident)
 	       restore(sp);
 	       if (ident->type_end == -1) {
 		    /* there was no tag. Insert { ... } */
+		    forget_lookahead();
 		    tos = curs;
 		    token_stack[curs].type = IDENTIFIER;
 		    token_stack[curs].token = "{ ... }";
+		    token_stack[curs].len = 7;
+		    token_stack[curs].hash = name_hash("{ ... }", 7);
 		    tos++;
 	       } else {
 		    tos = curs + 1;
 	       }
-	       tokpush(hold.type, hold.line, hold.token);
+	       tokpush(hold.type, hold.line, hold.token, hold.len, hold.hash);
 	  } else {
 	       if (tok.type != ';')
 		    file_error(_("missing `;' after struct declaration"), 0);
@@ -524,21 +743,23 @@ parse_variable_declaration(Ident *ident, int parm)
 	       restore(sp);
 	       if (ident->type_end == -1) {
 		    /* there was no tag. Insert { ... } */
+		    forget_lookahead();
 		    tos = curs;
 		    token_stack[curs].type = IDENTIFIER;
 		    token_stack[curs].token = "{ ... }";
+		    token_stack[curs].len = 7;
+		    token_stack[curs].hash = name_hash("{ ... }", 7);
 		    tos++;
 	       } else {
 		    tos = curs + 1;
 	       }
-	       tokpush(hold.type, hold.line, hold.token);
+	       tokpush(hold.type, hold.line, hold.token, hold.len, hold.hash);
 	  } else {
 	       if (tok.type == ';')
 		    return;
 	       restore(sp);
 	  }
      }
- again:
      parse_dcl(ident);
      
  select:    
@@ -557,9 +778,9 @@ parse_variable_declaration(Ident *ident, int parm)
      case ',':
 	  if (parm)
 	       break;
-	  tos = ident->type_end;
-	  restore(sp);
-	  goto again;
+	  next_dcl(sp[0] - 1, ident->type_end);
+	  parse_dcl_at(ident);
+	  goto select;
      case '=':
 	  nexttoken();
 	  if (tok.type == LBRACE || tok.type == LBRACE0)
@@ -578,33 +799,99 @@ parse_variable_declaration(Ident *ident, int parm)
      }
 }
 
+/* Read next token of an initializer list. Tokens already on the stack
+   are taken from it, new ones are not pushed, so that arbitrarily large
+   initializers are skipped in constant space. */
+static int
+init_token()
+{
+     if (curs < tos)
+	  return nexttoken();
+     tok.type = get_token();
+     tok.token = yylval.str;
+     tok.len = yylval.len;
+     tok.hash = yylval.hash;
+     tok.line = line_num;
+     return tok.type;
+}
+
+/* Skip initializer list. This is equivalent to calling expression() for
+   each of its elements, except that only identifiers are retained. */
 void
 initializer_list()
 {
      int lev = 0;
+     int parens_lev = 0;
+     int in_expr = 0;
+     char *name;
+     int len;
+     unsigned hash;
+     int line;
+
      while (1) {
 	  switch (tok.type) {
 	  case LBRACE:
 	  case LBRACE0:
+	       in_expr = parens_lev = 0;
 	       lev++;
 	       break;
 	  case RBRACE:
 	  case RBRACE0:
+	       in_expr = parens_lev = 0;
 	       if (--lev <= 0) {
 		    nexttoken();
 		    return;
 	       }
 	       break;
 	  case 0:
+	       if (in_expr && verbose)
+		    file_error(_("unexpected end of file in expression"), 0);
 	       file_error(_("unexpected end of file in initializer list"), 0);
 	       return;
+	  case ';':
+	       in_expr = parens_lev = 0;
+	       break;
 	  case ',':
+	       if (parens_lev == 0)
+		    in_expr = 0;
+	       break;
+	  case IDENTIFIER:
+	       in_expr = 1;
+	       name = tok.token;
+	       len = tok.len;
+	       hash = tok.hash;
+	       line = tok.line;
+	       if (init_token() == '(') {
+		    call(name, len, hash, line);
+		    parens_lev++;
+		    break;
+	       }
+	       reference(name, len, hash, line);
+	       if (tok.type != MEMBER_OF)
+		    continue;
+	       while (tok.type == MEMBER_OF)
+		    init_token();
+	       break;
+	  case '(':
+	       in_expr = 1;
+	       /* maybe typecast */
+	       if (init_token() == TYPE) {
+		    while (init_token() && tok.type != ')')
+			 ;
+	       } else {
+		    parens_lev++;
+		    continue;
+	       }
+	       break;
+	  case ')':
+	       in_expr = 1;
+	       parens_lev--;
 	       break;
 	  default:
-	       expression();
+	       in_expr = 1;
 	       break;
 	  }
-	  nexttoken();
+	  init_token();
      }
 }
 
@@ -647,8 +934,7 @@ parse_knr_dcl(Ident *ident)
 			      parmcnt++;
 			      if (tok.type == ',') {
 				   do {
-					tos = id.type_end; /* ouch! */
-					restore(new_sp);
+					next_dcl(new_sp[0], id.type_end);
 					dcl(&id);
 				   } while (tok.type == ',');
 			      } else if (tok.type != ';')
@@ -717,10 +1003,17 @@ parse_typedef()
 
 void
 parse_dcl(Ident *ident)
+{
+     putback();
+     parse_dcl_at(ident);
+}
+
+/* Parse a declarator starting at the current stack position */
+void
+parse_dcl_at(Ident *ident)
 {
      ident->parmcnt = -1;
      ident->name = NULL;
-     putback();
      dcl(ident);
      save_stack();
      if (ident->name)
@@ -729,12 +1022,32 @@ parse_dcl(Ident *ident)
 	  undo_save_stack();
 }
 
+/* Prepare the stack for parsing the next declarator in a
+   comma-separated list whose type specifiers start at stack position
+   START and end at TYPE_END. The specifiers need not be scanned again:
+   dcl() can resume right after them. The only exception is a trailing
+   run of identifiers, whose meaning depends on the token that follows
+   it. */
+void
+next_dcl(int start, int type_end)
+{
+     tos = type_end;
+     for (curs = type_end;
+	  curs > start && token_stack[curs-1].type == IDENTIFIER; curs--)
+	  ;
+}
+
 int
 dcl(Ident *idptr)
 {
      int type;
 
-     while (nexttoken() != 0 && tok.type != '(') {
+     if (idptr && idptr->type_end == -1 && lookahead_valid(curs)) {
+	  /* is_function() has already been here */
+	  idptr->type_end = lookahead.type_end;
+	  curs = lookahead.curs;
+	  tok = lookahead.tok;
+     } else while (nexttoken() != 0 && tok.type != '(') {
 	  if (tok.type == MODIFIER) {
 	       if (idptr && idptr->type_end == -1)
 		    idptr->type_end = curs-1;
@@ -764,7 +1077,12 @@ dirdcl(Ident *idptr)
      int *parm_ptr = NULL;
      
      if (tok.type == '(') {
-	  dcl(idptr);
+	  /* Empty parentheses would bring dcl() back here with the same
+	     token over and over */
+	  if (nexttoken() != ')') {
+	       putback();
+	       dcl(idptr);
+	  }
 	  if (tok.type != ')' && verbose) {
 	       file_error(_("expected `)'"), 1);
 	       return 1;
@@ -772,6 +1090,8 @@ dirdcl(Ident *idptr)
      } else if (tok.type == IDENTIFIER) {
 	  if (idptr) {
 	       idptr->name = tok.token;
+	       idptr->len = tok.len;
+	       idptr->hash = tok.hash;
 	       idptr->line = tok.line;
 	       parm_ptr = &idptr->parmcnt;
 	  }
@@ -898,7 +1218,7 @@ func_body()
      Ident ident;
      
      level++;
-     move_parms(level);
+     enter_body(level);
      while (level) {
 	  cleanup_stack();
 	  nexttoken();
@@ -929,14 +1249,14 @@ func_body()
 		    if (verbose && level != 1)
 			 file_error(_("forced function body close"), 0);
 		    for ( ; level; level--) {
-			 delete_autos(level);
+			 leave_block(level);
 		    }
 		    break;
 	       }
 	       /* else: */
 	       /* FALLTHRU */
 	  case '}':
-	       delete_autos(level);
+	       leave_block(level);
 	       level--;
 	       break;
 	  case 0:
@@ -947,6 +1267,1243 @@ func_body()
      }
 }
 
+/* Lazy parsing of function bodies.
+ *
+ * In lazy mode the bodies of function definitions are not parsed when
+ * read. Instead, skip_body() passes over them, and the location of each
+ * body is recorded in the function's symbol. Once all the input files
+ * have been read, parse_bodies() parses the bodies of the functions
+ * reachable from the start symbols, queueing the bodies of their callees
+ * as they are discovered.
+ */
+
+struct unit {
+     struct unit *next;     /* Next unit in input order */
+     int file;              /* Id of the source file */
+     struct body *head;     /* Bodies waiting to be parsed. During the
+			       first pass, all bodies from the file */
+     struct body *tail;
+     Symbol **symbols;      /* File-scope symbols, while not in the table */
+     size_t symbol_count;
+};
+
+struct body {
+     struct body *next;     /* Next body in the queue */
+     struct body *dup;      /* Next body of the same symbol */
+     struct unit *unit;     /* Source file */
+     Symbol *sym;           /* Function symbol */
+     int file;              /* Location of the opening brace */
+     int line;
+     long offset;
+     char **parms;          /* Names of the parameters */
+     int queued;            /* Has the body been queued? */
+     int ncallees;          /* Number of callees the symbol had when the
+			       body was read */
+     struct symbol_list callees; /* Callees found during the first pass after
+			       the body (see split_callees) */
+};
+
+static struct unit *unit_head, *unit_tail, *cur_unit;
+static int parsing_bodies;  /* Set while parse_bodies() is running */
+
+/* Start a new source file */
+void
+begin_unit()
+{
+     struct unit *up = xmalloc(sizeof(*up));
+
+     memset(up, 0, sizeof(*up));
+     up->file = canonical_filename_id;
+     if (unit_tail)
+	  unit_tail->next = up;
+     else
+	  unit_head = up;
+     unit_tail = cur_unit = up;
+}
+
+/* Finish the current source file. This is called instead of
+   delete_statics() when the end of file is reached in lazy mode. */
+void
+end_unit()
+{
+     if (cur_unit && !parsing_bodies) {
+	  cur_unit->symbol_count = detach_unit_symbols(&cur_unit->symbols);
+	  cur_unit = NULL;
+     }
+}
+
+/* Record the body of the function SP, whose opening brace is in tok,
+   and skip over it */
+void
+defer_body(Symbol *sp)
+{
+     struct body *bp, **bpp;
+     int type;
+
+     bp = xmalloc(sizeof(*bp));
+     bp->next = bp->dup = NULL;
+     bp->unit = cur_unit;
+     bp->sym = sp;
+     bp->file = filename_id;
+     bp->line = tok.line;
+     bp->offset = token_offset;
+     bp->parms = parm_names();
+     bp->queued = 0;
+     bp->ncallees = sp->callee.count;
+     memset(&bp->callees, 0, sizeof(bp->callees));
+     for (bpp = &sp->body; *bpp; bpp = &(*bpp)->dup)
+	  ;
+     *bpp = bp;
+     if (cur_unit->tail)
+	  cur_unit->tail->next = bp;
+     else
+	  cur_unit->head = bp;
+     cur_unit->tail = bp;
+     
+     type = skip_body();
+     tokpush(type, line_num, NULL, 0, 0);
+     nexttoken();
+}
+
+/* The bodies of SP follow it when it is moved to another Symbol
+   structure (see install_hashed) */
+void
+moved_bodies(Symbol *sp)
+{
+     struct body *bp;
+
+     for (bp = sp->body; bp; bp = bp->dup)
+	  bp->sym = sp;
+}
+
+static void
+queue_bodies(Symbol *sp)
+{
+     struct body *bp;
+
+     for (bp = sp->body; bp; bp = bp->dup) {
+	  if (bp->queued)
+	       continue;
+	  bp->queued = 1;
+	  bp->next = NULL;
+	  if (bp->unit->tail)
+	       bp->unit->tail->next = bp;
+	  else
+	       bp->unit->head = bp;
+	  bp->unit->tail = bp;
+     }
+}
+
+/* Prepare for parsing the body BP: position the input at its opening
+   brace and declare its parameters. Return nonzero on error. */
+static int
+begin_body(struct body *bp)
+{
+     Symbol *sp;
+     char **p;
+
+     if (resume_source(file_name(bp->unit->file), bp->offset))
+	  return 1;
+     set_filename(bp->file);
+     line_num = bp->line;
+     clearstack();
+     level = 0;
+     for (p = bp->parms; *p; p++) {
+	  sp = install(*p);
+	  sp->type = SymIdentifier;
+	  sp->storage = AutoStorage;
+	  sp->level = 1;
+	  sp->flag = symbol_parm;
+	  sp->arity = -1;
+     }
+
+     caller = bp->sym;
+     nexttoken();
+     return 0;
+}
+
+/* Finish the body BP: add the callees found after it during the first
+   pass, and queue the bodies of all its callees. A malformed body may
+   leave no caller behind, and then there is nothing to add them to. */
+static void
+end_body(struct body *bp)
+{
+     Symbol **p, *sp = caller ? caller : bp->sym;
+     unsigned i;
+
+     if (caller) {
+	  p = SYMBOL_LIST_PTR(&bp->callees);
+	  for (i = 0; i < bp->callees.count; i++)
+	       if (!symbol_in_list(p[i], &caller->callee))
+		    symbol_list_append(&caller->callee, p[i]);
+     }
+     symbol_list_free(&bp->callees);
+
+     p = SYMBOL_LIST_PTR(&sp->callee);
+     for (i = 0; i < sp->callee.count; i++)
+	  queue_bodies(p[i]);
+}
+
+static void
+parse_body(struct body *bp)
+{
+     if (begin_body(bp))
+	  return;
+     func_body();
+     end_body(bp);
+}
+
+/* Parallel parsing of function bodies.
+ *
+ * With --jobs, the queue of bodies waiting to be parsed in a source
+ * file is split into runs of consecutive bodies, and each run is given
+ * to a child process. Instead of its symbol table, the child reports
+ * the effects each body has beyond itself: the calls and references it
+ * makes and the static symbols it declares. The parent replays these
+ * in the order of the queue, so the result is the same as if it had
+ * parsed the bodies itself.
+ *
+ * This holds as long as a body does not change the way the bodies that
+ * follow it are read, e.g. by declaring a type, and does not print any
+ * diagnostics. A child stops at the first body for which this is not
+ * certain and reports it as unclean. The parent then parses that body
+ * itself and starts new children for the rest of the queue.
+ */
+
+enum body_event_type {
+     ev_call,
+     ev_reference,
+     ev_declare,
+     ev_filename,
+     ev_type,
+     ev_caller,
+     ev_source,
+     ev_end,
+     ev_auto,
+     ev_delete_autos,
+     ev_delete_parms,
+     ev_move_parms
+};
+
+/* An event in the log of a body. It is followed by LEN characters of
+   the name it refers to, and, for ev_declare, DECL_LEN characters of
+   the declaration. */
+struct body_event {
+     enum body_event_type type;
+     int line;
+     int len;
+     unsigned hash;
+     int parmcnt;           /* For ev_declare: */
+     enum storage storage;
+     int level;
+     int decl_len;
+};
+
+static struct obstack *body_log; /* Events of the body being parsed by
+				    a child process */
+static int body_unclean;         /* Set if the body is unclean */
+static int logged_file;          /* Id of the file the events refer to */
+
+/* Note that the body being parsed by a child process is unclean */
+static void
+mark_unclean()
+{
+     if (body_log)
+	  body_unclean = 1;
+}
+
+static void
+log_event(struct body_event *ev, char *name, char *decl)
+{
+     if (filename_id != logged_file) {
+	  struct body_event fev;
+
+	  memset(&fev, 0, sizeof fev);
+	  fev.type = ev_filename;
+	  fev.len = strlen(filename);
+	  obstack_grow(body_log, &fev, sizeof fev);
+	  obstack_grow(body_log, filename, fev.len);
+	  logged_file = filename_id;
+     }
+     obstack_grow(body_log, ev, sizeof *ev);
+     obstack_grow(body_log, name, ev->len);
+     if (ev->decl_len)
+	  obstack_grow(body_log, decl, ev->decl_len);
+}
+
+/* Log a call or reference (TYPE) to NAME, made at LINE */
+static void
+log_reference(enum body_event_type type, char *name, int len, unsigned hash,
+	      int line)
+{
+     struct body_event ev;
+
+     memset(&ev, 0, sizeof ev);
+     ev.type = type;
+     ev.line = line;
+     ev.len = len;
+     ev.hash = hash;
+     log_event(&ev, name, NULL);
+}
+
+/* Log the event TYPE, which refers to IDENT */
+static void
+log_ident(enum body_event_type type, Ident *ident)
+{
+     struct body_event ev;
+
+     memset(&ev, 0, sizeof ev);
+     ev.type = type;
+     ev.line = ident->line;
+     ev.len = ident->len;
+     ev.hash = ident->hash;
+     log_event(&ev, ident->name, NULL);
+}
+
+/* Log the new caller IDENT */
+static void
+log_caller(Ident *ident)
+{
+     if (body_log)
+	  log_ident(ev_caller, ident);
+}
+
+/* Log the change of scope TYPE at LEVEL. The scopes are only logged in
+   partial graphs: a body parsed by a child process declares and deletes
+   its local symbols itself. */
+static void
+log_scope(enum body_event_type type, int level)
+{
+     struct body_event ev;
+
+     if (body_log && partial_option) {
+	  memset(&ev, 0, sizeof ev);
+	  ev.type = type;
+	  ev.level = level;
+	  log_event(&ev, "", NULL);
+     }
+}
+
+/* Delete the automatic variables of the block at LEVEL */
+static void
+leave_block(int level)
+{
+     delete_autos(level);
+     log_scope(ev_delete_autos, level);
+}
+
+/* Delete the parameters of the parameter nesting level above LEVEL */
+static void
+leave_parms(int level)
+{
+     delete_parms(level);
+     log_scope(ev_delete_parms, level);
+}
+
+/* Make the saved parameters automatic variables of the body at LEVEL */
+static void
+enter_body(int level)
+{
+     move_parms(level);
+     log_scope(ev_move_parms, level);
+}
+
+/* Log the definition of IDENT as DECL */
+static void
+log_declare(Ident *ident, char *decl)
+{
+     struct body_event ev;
+
+     memset(&ev, 0, sizeof ev);
+     ev.type = ev_declare;
+     ev.line = ident->line;
+     ev.len = ident->len;
+     ev.hash = ident->hash;
+     ev.parmcnt = ident->parmcnt;
+     ev.storage = ident->storage;
+     ev.level = level;
+     ev.decl_len = strlen(decl);
+     log_event(&ev, ident->name, decl);
+}
+
+/* Parse the N bodies at BODIES in a child process and write their
+   events to LOG. Each body is recorded as the size of its events
+   followed by the events themselves. The size of an unclean body is 0,
+   and the child stops there. */
+static void
+parse_run(struct body **bodies, size_t n, FILE *log)
+{
+     struct obstack stk;
+     struct body *bp;
+     size_t i, size;
+     char *p;
+
+     obstack_init(&stk);
+     body_log = &stk;
+     for (i = 0; i < n; i++) {
+	  bp = bodies[i];
+	  body_unclean = 0;
+	  logged_file = bp->file;
+	  if (begin_body(bp) == 0)
+	       func_body();
+	  else
+	       body_unclean = 1;
+	  /* Anything printed makes the body unclean */
+	  fflush(stdout);
+	  fflush(stderr);
+	  if (level != 0 || caller != bp->sym || lseek(1, 0, SEEK_CUR) != 0)
+	       body_unclean = 1;
+	  size = body_unclean ? 0 : obstack_object_size(&stk);
+	  p = obstack_finish(&stk);
+	  fwrite(&size, sizeof size, 1, log);
+	  fwrite(p, 1, size, log);
+	  obstack_free(&stk, p);
+	  if (body_unclean)
+	       break;
+     }
+     fflush(log);
+}
+
+/* Do what the event EV did when it was logged. NAME is the name that
+   follows it in the log. */
+static void
+replay_event(struct body_event *ev, char *name)
+{
+     Symbol *sp;
+     Ident ident;
+
+     ident.name = name;
+     ident.len = ev->len;
+     ident.hash = ev->hash;
+     ident.line = ev->line;
+     switch (ev->type) {
+     case ev_call:
+	  call(name, ev->len, ev->hash, ev->line);
+	  break;
+     case ev_reference:
+	  reference(name, ev->len, ev->hash, ev->line);
+	  break;
+     case ev_declare:
+	  ident.parmcnt = ev->parmcnt;
+	  ident.storage = ev->storage;
+	  level = ev->level;
+	  sp = get_symbol(name, ev->len, ev->hash);
+	  if (sp)
+	       define_symbol(sp, &ident,
+			     obstack_copy0(&text_stk, name + ev->len,
+					   ev->decl_len));
+	  break;
+     case ev_filename:
+	  set_filename(file_id(name, ev->len, name_hash(name, ev->len)));
+	  break;
+     case ev_type:
+	  declare_type(&ident);
+	  break;
+     case ev_caller:
+	  caller = lookup_hashed(name, ev->len, ev->hash);
+	  break;
+     case ev_source:
+	  set_filename(file_id(name, ev->len, name_hash(name, ev->len)));
+	  canonical_filename_id = filename_id;
+	  break;
+     case ev_auto:
+	  declare_auto(&ident, ev->parmcnt, ev->level);
+	  break;
+     case ev_delete_autos:
+	  delete_autos(ev->level);
+	  break;
+     case ev_delete_parms:
+	  delete_parms(ev->level);
+	  break;
+     case ev_move_parms:
+	  move_parms(ev->level);
+	  break;
+     case ev_end:
+	  delete_statics();
+	  reset_scratch();
+	  caller = NULL;
+	  level = 0;
+	  break;
+     }
+}
+
+/* Replay the events of the body BP from LOG. Return 0 on success, and
+   -1 if the body is unclean or its record is incomplete. */
+static int
+replay_body(struct body *bp, FILE *log)
+{
+     static char *buf;
+     static size_t bufsize;
+     struct body_event ev;
+     size_t size;
+     char *p, *end, *name;
+
+     if (fread(&size, sizeof size, 1, log) != 1 || size == 0)
+	  return -1;
+     if (size > bufsize) {
+	  bufsize = size;
+	  buf = xrealloc(buf, bufsize);
+     }
+     if (fread(buf, 1, size, log) != size)
+	  return -1;
+
+     set_filename(bp->file);
+     line_num = bp->line;
+     caller = bp->sym;
+     for (p = buf, end = buf + size; p < end; ) {
+	  memcpy(&ev, p, sizeof ev);
+	  name = p + sizeof ev;
+	  p = name + ev.len + ev.decl_len;
+	  replay_event(&ev, name);
+     }
+     level = 0;
+     end_body(bp);
+     return 0;
+}
+
+struct run {
+     pid_t pid;             /* Child process parsing the run */
+     FILE *log;             /* Its log */
+     size_t count;          /* Number of bodies in the run */
+};
+
+/* Start a child process parsing the N bodies at BODIES into LOG.
+   Its output goes to a temporary file, so that parse_run can tell
+   whether anything was printed. */
+static pid_t
+fork_run(struct body **bodies, size_t n, FILE *log)
+{
+     pid_t pid;
+     FILE *fp;
+
+     pid = fork();
+     if (pid == 0) {
+	  fp = tmpfile();
+	  if (fp && dup2(fileno(fp), 1) == 1 && dup2(fileno(fp), 2) == 2)
+	       parse_run(bodies, n, log);
+	  _exit(0);
+     }
+     return pid;
+}
+
+/* Parse the N bodies at BODIES, splitting them among jobs_option child
+   processes. Return the number of bodies parsed, which is less than N
+   if one of them turned out to be unclean. */
+static size_t
+parse_parallel(struct body **bodies, size_t n)
+{
+     struct run *runs;
+     size_t i, m, done;
+     int k, nruns;
+
+     runs = xcalloc(jobs_option, sizeof(*runs));
+     m = (n + jobs_option - 1) / jobs_option;
+     fflush(NULL);
+     for (nruns = 0, i = 0; i < n; nruns++, i += m) {
+	  runs[nruns].count = n - i < m ? n - i : m;
+	  runs[nruns].log = tmpfile();
+	  runs[nruns].pid = runs[nruns].log ?
+	       fork_run(bodies + i, runs[nruns].count, runs[nruns].log) : -1;
+     }
+
+     done = 0;
+     for (k = 0; k < nruns; k++) {
+	  if (runs[k].pid == -1)
+	       break;
+	  waitpid(runs[k].pid, NULL, 0);
+	  runs[k].pid = 0;
+	  rewind(runs[k].log);
+	  for (i = 0; i < runs[k].count; i++, done++)
+	       if (replay_body(bodies[done], runs[k].log))
+		    break;
+	  if (i < runs[k].count)
+	       break;
+     }
+
+     for (k = 0; k < nruns; k++) {
+	  if (runs[k].pid > 0) {
+	       kill(runs[k].pid, SIGKILL);
+	       waitpid(runs[k].pid, NULL, 0);
+	  }
+	  if (runs[k].log)
+	       fclose(runs[k].log);
+     }
+     free(runs);
+     return done;
+}
+
+/* Parse the bodies queued for the unit UP, in parallel where there are
+   enough of them. The bodies queued meanwhile are left in UP. */
+static void
+parse_queue_parallel(struct unit *up)
+{
+     struct body **bodies, *bp;
+     size_t i, n;
+
+     for (n = 0, bp = up->head; bp; bp = bp->next)
+	  n++;
+     bodies = xcalloc(n, sizeof(*bodies));
+     for (n = 0, bp = up->head; bp; bp = bp->next)
+	  bodies[n++] = bp;
+     up->head = up->tail = NULL;
+
+     for (i = 0; i < n; ) {
+	  if (n - i >= 2 * jobs_option)
+	       i += parse_parallel(bodies + i, n - i);
+	  if (i < n)
+	       parse_body(bodies[i++]);
+     }
+     free(bodies);
+}
+
+/* The callees SP got during the first pass come from the declarations
+   following its bodies (see parse_function_declaration), so they must
+   follow the callees found in the respective body. Distribute them
+   among the bodies. */
+static void
+split_callees(Symbol *sp)
+{
+     struct body *bp;
+     Symbol **p;
+     int n;
+
+     p = SYMBOL_LIST_PTR(&sp->callee);
+     for (n = 0, bp = sp->body; n < sp->callee.count; n++) {
+	  while (bp->dup && n >= bp->dup->ncallees)
+	       bp = bp->dup;
+	  symbol_list_append(&bp->callees, p[n]);
+     }
+     symbol_list_free(&sp->callee);
+}
+
+static void
+parse_unit_bodies(struct unit *up)
+{
+     struct body *bp;
+     
+     attach_symbols(up->symbols, up->symbol_count);
+     free(up->symbols);
+     canonical_filename_id = up->file;
+     if (jobs_option > 1 && !debug)
+	  while (up->head)
+	       parse_queue_parallel(up);
+     while ((bp = up->head) != NULL) {
+	  up->head = bp->next;
+	  if (!up->head)
+	       up->tail = NULL;
+	  parse_body(bp);
+     }
+     close_source();
+     up->symbol_count = detach_unit_symbols(&up->symbols);
+}
+
+/* Parse the bodies of all functions reachable from the start symbols.
+   If none of them is defined, parse all bodies. */
+void
+parse_bodies()
+{
+     struct unit *up;
+     struct body *bp;
+     Symbol *sp;
+     size_t i;
+     int more, reachable = 0;
+     
+     parsing_bodies = 1;
+     for (up = unit_head; up; up = up->next)
+	  for (bp = up->head; bp; bp = bp->next)
+	       if (bp == bp->sym->body)
+		    split_callees(bp->sym);
+
+     /* With --auto-start, the start symbols are not known before all
+	bodies are parsed */
+     if (!auto_start_option)
+	  for (i = 0; i < start_name_count; i++) {
+	       sp = lookup(start_names[i]);
+	       if (sp && sp->body) {
+		    if (!reachable) {
+			 for (up = unit_head; up; up = up->next)
+			      up->head = up->tail = NULL;
+			 reachable = 1;
+		    }
+		    queue_bodies(sp);
+	       }
+	  }
+     if (!reachable) {
+	  /* Parse everything, in the order of appearance */
+	  for (up = unit_head; up; up = up->next)
+	       for (bp = up->head; bp; bp = bp->next)
+		    bp->queued = 1;
+     }
+     
+     do {
+	  more = 0;
+	  for (up = unit_head; up; up = up->next) 
+	       if (up->head) {
+		    parse_unit_bodies(up);
+		    more = 1;
+	       }
+     } while (more);
+
+     /* Put back the file-scope symbols that normal mode would have kept */
+     for (up = unit_head; up; up = up->next) {
+	  size_t n = 0;
+	  
+	  for (i = 0; i < up->symbol_count; i++) {
+	       sp = up->symbols[i];
+	       if (sp->flag == symbol_temp || globals_only()) {
+		    /* A deleted symbol stays in the table, unless it
+		       shadowed another one (see delete_symbol) */
+		    sp->type = SymUndefined;
+		    if (lookup_hashed(sp->name, sp->len, sp->hash))
+			 continue;
+	       }
+	       up->symbols[n++] = sp;
+	  }
+	  attach_symbols(up->symbols, n);
+	  free(up->symbols);
+     }
+     parsing_bodies = 0;
+}
+
+/* Partial graphs.
+ *
+ * With --partial, the events of all source files are logged the same
+ * way as those of the bodies parsed by --jobs, together with the
+ * changes of scope, and written to the output file at the end of each
+ * file. Such a file is a partial graph. --merge replays the events of
+ * the partial graphs it is given, which builds the same symbol table
+ * as parsing their source files in that order would have, in time
+ * proportional to the number of events. With both options, the events
+ * are copied instead, which makes a partial graph out of several ones.
+ *
+ * A partial graph starts with PARTIAL_MAGIC and PARTIAL_VERSION. Each
+ * event is written as its type, in one byte, followed by the fields
+ * that the type uses (see write_event). Numbers are written as
+ * varints, 7 bits per byte, with the signed ones folded to unsigned
+ * and the line numbers as the difference from the previous one. The
+ * names are numbered in the order they first appear in a source file:
+ * a name is written as its number, or as 0 followed by its length and
+ * text when it appears for the first time.
+ *
+ * A declaration is written as the tokens it is made of, so that its
+ * text is composed by the run that merges the partial graph, with the
+ * output options of that run (see compose_decl).
+ */
+
+#define PARTIAL_MAGIC "CFLOWPG"   /* With the trailing NUL */
+#define PARTIAL_VERSION 2
+
+/* A token of a declaration in the log of the current file. It is
+   followed by LEN characters of its text. */
+struct partial_token {
+     int type;
+     int len;
+};
+
+struct partial_name {
+     char *text;
+     int len;
+     unsigned hash;
+     unsigned long index;   /* Its number in the current source file */
+};
+
+static struct obstack partial_stk;  /* Events of the current file */
+static struct obstack encode_stk;   /* Their encoded form */
+static struct obstack name_stk;     /* struct partial_name */
+static Hash_table *name_table;      /* Names of the current file */
+static unsigned long name_count;
+static int last_line;
+
+static size_t
+partial_name_hasher(void const *data, size_t n_buckets)
+{
+     struct partial_name const *np = data;
+     return np->hash % n_buckets;
+}
+
+static bool
+partial_name_compare(void const *data1, void const *data2)
+{
+     struct partial_name const *n1 = data1;
+     struct partial_name const *n2 = data2;
+     return n1->hash == n2->hash
+	    && n1->len == n2->len
+	    && memcmp(n1->text, n2->text, n1->len) == 0;
+}
+
+static void
+write_partial(void *p, size_t size)
+{
+     if (fwrite(p, 1, size, outfile) != size)
+	  error(1, errno, _("cannot write `%s'"), outname);
+}
+
+static void
+encode_number(unsigned long n)
+{
+     while (n >= 0x80) {
+	  obstack_1grow(&encode_stk, (n & 0x7f) | 0x80);
+	  n >>= 7;
+     }
+     obstack_1grow(&encode_stk, n);
+}
+
+static void
+encode_signed(long n)
+{
+     encode_number(n < 0 ? ((unsigned long) -(n + 1) << 1) | 1 : n << 1);
+}
+
+static void
+encode_name(char *text, int len, unsigned hash)
+{
+     struct partial_name key, *np;
+
+     key.text = text;
+     key.len = len;
+     key.hash = hash;
+     np = hash_lookup(name_table, &key);
+     if (np) {
+	  encode_number(np->index);
+	  return;
+     }
+     np = obstack_alloc(&name_stk, sizeof *np);
+     *np = key;
+     np->index = ++name_count;
+     if (!hash_insert(name_table, np))
+	  xalloc_die();
+     encode_number(0);
+     encode_number(len);
+     obstack_grow(&encode_stk, text, len);
+}
+
+/* Does a token of TYPE need its text in a declaration (see save_token)? */
+static int
+token_has_text(int type)
+{
+     switch (type) {
+     case IDENTIFIER:
+     case TYPE:
+     case STRUCT:
+     case PARM_WRAPPER:
+     case WORD:
+     case MODIFIER:
+	  return 1;
+     }
+     return 0;
+}
+
+/* Log the definition of IDENT, with the tokens saved for its
+   declaration */
+static void
+log_partial_declare(Ident *ident)
+{
+     struct body_event ev;
+     struct partial_token pt;
+     int i, count = save_end > 0 ? save_end : 0;
+     char *name;
+
+     /* The tokens point into the input buffer, so they are copied along
+	with their text. encode_stk is free until the end of the file. */
+     obstack_grow(&encode_stk, ident->name, ident->len);
+     for (i = 0; i < count; i++) {
+	  pt.type = token_stack[i].type;
+	  pt.len = token_has_text(pt.type) ? token_stack[i].len : 0;
+	  obstack_grow(&encode_stk, &pt, sizeof pt);
+	  obstack_grow(&encode_stk, token_stack[i].token, pt.len);
+     }
+     memset(&ev, 0, sizeof ev);
+     ev.type = ev_declare;
+     ev.line = ident->line;
+     ev.len = ident->len;
+     ev.hash = ident->hash;
+     ev.parmcnt = ident->parmcnt;
+     ev.storage = ident->storage;
+     ev.level = level;
+     ev.decl_len = obstack_object_size(&encode_stk) - ident->len;
+     name = obstack_finish(&encode_stk);
+     log_event(&ev, name, name + ident->len);
+     obstack_free(&encode_stk, name);
+}
+
+/* Encode the DECL_LEN bytes of declaration tokens at DECL */
+static void
+encode_tokens(char *decl, size_t decl_len)
+{
+     struct partial_token pt;
+     char *p, *end = decl + decl_len;
+     unsigned long count = 0;
+
+     for (p = decl; p < end; p += sizeof pt + pt.len, count++)
+	  memcpy(&pt, p, sizeof pt);
+     encode_number(count);
+     for (p = decl; p < end; p += sizeof pt + pt.len) {
+	  memcpy(&pt, p, sizeof pt);
+	  encode_number(pt.type);
+	  if (token_has_text(pt.type))
+	       encode_name(p + sizeof pt, pt.len,
+			   name_hash(p + sizeof pt, pt.len));
+     }
+}
+
+/* Encode the event EV, whose name and declaration are at NAME */
+static void
+write_event(struct body_event *ev, char *name)
+{
+     obstack_1grow(&encode_stk, ev->type);
+     switch (ev->type) {
+     case ev_call:
+     case ev_reference:
+     case ev_type:
+     case ev_caller:
+	  encode_signed(ev->line - last_line);
+	  last_line = ev->line;
+	  encode_name(name, ev->len, ev->hash);
+	  break;
+     case ev_declare:
+	  encode_signed(ev->line - last_line);
+	  last_line = ev->line;
+	  encode_name(name, ev->len, ev->hash);
+	  encode_signed(ev->parmcnt);
+	  encode_number(ev->storage);
+	  encode_signed(ev->level);
+	  encode_tokens(name + ev->len, ev->decl_len);
+	  break;
+     case ev_filename:
+     case ev_source:
+	  encode_name(name, ev->len, name_hash(name, ev->len));
+	  break;
+     case ev_auto:
+	  encode_name(name, ev->len, ev->hash);
+	  encode_number(ev->parmcnt);
+	  encode_signed(ev->level);
+	  break;
+     case ev_delete_autos:
+     case ev_delete_parms:
+     case ev_move_parms:
+	  encode_signed(ev->level);
+	  break;
+     case ev_end:
+	  break;
+     }
+}
+
+/* Start writing a partial graph */
+void
+begin_partial()
+{
+     open_output();
+     write_partial(PARTIAL_MAGIC, sizeof PARTIAL_MAGIC);
+     putc(PARTIAL_VERSION, outfile);
+     if (!merge_option) {
+	  obstack_init(&partial_stk);
+	  obstack_init(&encode_stk);
+	  obstack_init(&name_stk);
+	  name_table = hash_initialize(0, 0,
+				       partial_name_hasher,
+				       partial_name_compare, 0);
+	  if (!name_table)
+	       xalloc_die();
+	  body_log = &partial_stk;
+     }
+}
+
+/* Log the beginning of a source file. The symbols installed while
+   reading the files it includes are temporary (see install_hashed). */
+static void
+begin_partial_unit()
+{
+     struct body_event ev;
+     char *name = file_name(canonical_filename_id);
+     
+     memset(&ev, 0, sizeof ev);
+     ev.type = ev_source;
+     ev.len = strlen(name);
+     obstack_grow(body_log, &ev, sizeof ev);
+     obstack_grow(body_log, name, ev.len);
+     logged_file = canonical_filename_id;
+}
+
+/* Write the events of the source file just parsed */
+static void
+end_partial_unit()
+{
+     struct body_event ev;
+     char *start, *p, *end, *name;
+     size_t size;
+     
+     memset(&ev, 0, sizeof ev);
+     ev.type = ev_end;
+     obstack_grow(body_log, &ev, sizeof ev);
+     size = obstack_object_size(body_log);
+     start = obstack_finish(body_log);
+     for (p = start, end = start + size; p < end; ) {
+	  memcpy(&ev, p, sizeof ev);
+	  name = p + sizeof ev;
+	  p = name + ev.len + ev.decl_len;
+	  write_event(&ev, name);
+     }
+     size = obstack_object_size(&encode_stk);
+     p = obstack_finish(&encode_stk);
+     write_partial(p, size);
+     obstack_free(&encode_stk, p);
+     obstack_free(body_log, start);
+
+     /* The names are numbered anew in each file */
+     hash_clear(name_table);
+     obstack_free(&name_stk, NULL);
+     obstack_init(&name_stk);
+     name_count = 0;
+     last_line = 0;
+     logged_file = 0;
+}
+
+/* Finish writing a partial graph */
+void
+end_partial()
+{
+     if (fclose(outfile))
+	  error(1, errno, _("cannot write `%s'"), outname);
+}
+
+/* Reading partial graphs */
+static FILE *merge_fp;
+static char *merge_name;
+static struct partial_name *merge_names;
+static unsigned long merge_name_max;
+
+static void
+truncated()
+{
+     if (ferror(merge_fp))
+	  error(1, errno, _("cannot read `%s'"), merge_name);
+     error(1, 0, _("%s: partial graph is truncated"), merge_name);
+}
+
+static unsigned long
+decode_number()
+{
+     unsigned long n = 0;
+     int shift = 0;
+     int c;
+
+     do {
+	  if ((c = getc(merge_fp)) == EOF)
+	       truncated();
+	  n |= (unsigned long) (c & 0x7f) << shift;
+	  shift += 7;
+     } while (c & 0x80);
+     return n;
+}
+
+static long
+decode_signed()
+{
+     unsigned long n = decode_number();
+     return n & 1 ? -(long) (n >> 1) - 1 : (long) (n >> 1);
+}
+
+/* Read LEN bytes into the buffer being grown in name_stk */
+static void
+decode_text(size_t len)
+{
+     int c;
+     
+     while (len--) {
+	  if ((c = getc(merge_fp)) == EOF)
+	       truncated();
+	  obstack_1grow(&name_stk, c);
+     }
+}
+
+/* Read a name and set the name fields of EV from it. Return its text. */
+static char *
+decode_name(struct body_event *ev)
+{
+     unsigned long index = decode_number();
+     struct partial_name *np;
+
+     if (index > name_count)
+	  error(1, 0, _("%s: invalid partial graph"), merge_name);
+     if (index == 0) {
+	  if (name_count == merge_name_max) {
+	       merge_name_max = merge_name_max ? 2 * merge_name_max : 1024;
+	       merge_names = xrealloc(merge_names,
+				      merge_name_max * sizeof *merge_names);
+	  }
+	  np = &merge_names[name_count++];
+	  np->len = decode_number();
+	  decode_text(np->len);
+	  obstack_1grow(&name_stk, 0);
+	  np->text = obstack_finish(&name_stk);
+	  np->hash = name_hash(np->text, np->len);
+     } else
+	  np = &merge_names[index - 1];
+     ev->len = np->len;
+     ev->hash = np->hash;
+     return np->text;
+}
+
+/* Read the tokens of a declaration and compose its text on text_stk.
+   NAME is the name being declared. Return the text. */
+static char *
+decode_decl(char *name, int len)
+{
+     static TOKSTK *stk;
+     static size_t stk_max;
+     struct body_event tev;
+     unsigned long i, count = decode_number();
+
+     if (count > stk_max) {
+	  stk_max = count;
+	  stk = xrealloc(stk, stk_max * sizeof *stk);
+     }
+     for (i = 0; i < count; i++) {
+	  stk[i].type = decode_number();
+	  if (token_has_text(stk[i].type)) {
+	       stk[i].token = decode_name(&tev);
+	       stk[i].len = tev.len;
+	  } else {
+	       stk[i].token = "";
+	       stk[i].len = 0;
+	  }
+     }
+     return compose_decl(stk, count, name, len);
+}
+
+/* Read an event into EV. Return its name, which for ev_declare is
+   followed by the declaration, or NULL at the end of the file. */
+static char *
+read_event(struct body_event *ev)
+{
+     static char *buf;
+     static size_t bufsize;
+     char *name = "", *decl;
+     int c;
+
+     if ((c = getc(merge_fp)) == EOF)
+	  return NULL;
+     memset(ev, 0, sizeof *ev);
+     ev->type = c;
+     switch (ev->type) {
+     case ev_call:
+     case ev_reference:
+     case ev_type:
+     case ev_caller:
+	  last_line += decode_signed();
+	  ev->line = last_line;
+	  name = decode_name(ev);
+	  break;
+     case ev_declare:
+	  last_line += decode_signed();
+	  ev->line = last_line;
+	  name = decode_name(ev);
+	  ev->parmcnt = decode_signed();
+	  ev->storage = decode_number();
+	  ev->level = decode_signed();
+	  decl = decode_decl(name, ev->len);
+	  ev->decl_len = strlen(decl);
+	  if (ev->len + ev->decl_len + 1 > bufsize) {
+	       bufsize = ev->len + ev->decl_len + 1;
+	       buf = xrealloc(buf, bufsize);
+	  }
+	  memcpy(buf, name, ev->len);
+	  memcpy(buf + ev->len, decl, ev->decl_len + 1);
+	  obstack_free(&text_stk, decl);
+	  name = buf;
+	  break;
+     case ev_filename:
+     case ev_source:
+	  name = decode_name(ev);
+	  break;
+     case ev_auto:
+	  name = decode_name(ev);
+	  ev->parmcnt = decode_number();
+	  ev->level = decode_signed();
+	  break;
+     case ev_delete_autos:
+     case ev_delete_parms:
+     case ev_move_parms:
+	  ev->level = decode_signed();
+	  break;
+     case ev_end:
+	  name_count = 0;
+	  last_line = 0;
+	  obstack_free(&name_stk, NULL);
+	  obstack_init(&name_stk);
+	  break;
+     default:
+	  error(1, 0, _("%s: invalid partial graph"), merge_name);
+     }
+     return name;
+}
+
+/* Merge the partial graph in the file NAME */
+void
+merge_partial(char *name)
+{
+     char magic[sizeof PARTIAL_MAGIC];
+     char buf[BUFSIZ];
+     struct body_event ev;
+     char *text;
+     size_t size;
+
+     merge_fp = fopen(name, "r");
+     if (!merge_fp) {
+	  error(0, errno, _("cannot open `%s'"), name);
+	  return;
+     }
+     merge_name = name;
+     if (fread(magic, sizeof magic, 1, merge_fp) != 1
+	 || memcmp(magic, PARTIAL_MAGIC, sizeof magic)
+	 || getc(merge_fp) != PARTIAL_VERSION)
+	  error(1, 0, _("%s: not a partial graph of this version of cflow"),
+		name);
+     input_file_count++;
+     if (partial_option) {
+	  while ((size = fread(buf, 1, sizeof buf, merge_fp)) > 0)
+	       write_partial(buf, size);
+     } else {
+	  obstack_init(&name_stk);
+	  ev.type = ev_end;
+	  while ((text = read_event(&ev)) != NULL)
+	       replay_event(&ev, text);
+	  if (ev.type != ev_end)
+	       truncated();
+	  obstack_free(&name_stk, NULL);
+     }
+     if (ferror(merge_fp))
+	  error(1, errno, _("cannot read `%s'"), name);
+     fclose(merge_fp);
+}
+
+/* Declare IDENT as an automatic variable of the nesting level LEV, or
+   as a parameter of the parameter nesting level LEV if PARM is set */
+static void
+declare_auto(Ident *ident, int parm, int lev)
+{
+     Symbol *sp;
+
+     sp = install_hashed(ident->name, ident->len, ident->hash);
+     sp->type = SymIdentifier;
+     sp->storage = AutoStorage;
+     sp->level = lev;
+     if (parm)
+	  sp->flag = symbol_parm;
+     sp->arity = -1;
+     if (body_log && partial_option) {
+	  struct body_event ev;
+
+	  memset(&ev, 0, sizeof ev);
+	  ev.type = ev_auto;
+	  ev.len = ident->len;
+	  ev.hash = ident->hash;
+	  ev.parmcnt = parm;
+	  ev.level = lev;
+	  log_event(&ev, ident->name, NULL);
+     }
+}
+
 void
 declare(Ident *ident)
 {
@@ -954,15 +2511,10 @@ declare(Ident *ident)
      
      if (ident->storage == AutoStorage) {
 	  undo_save_stack();
-	  sp = install(ident->name);
-	  sp->type = SymIdentifier;
-	  sp->storage = ident->storage;
-	  if (parm_level) {
-	       sp->level = parm_level;
-	       sp->flag = symbol_parm;
-	  } else
-	       sp->level = level;
-	  sp->arity = -1;
+	  if (parm_level)
+	       declare_auto(ident, 1, parm_level);
+	  else
+	       declare_auto(ident, 0, level);
 	  return;
      } 
      
@@ -973,15 +2525,29 @@ declare(Ident *ident)
 	  return;
      }
      
-     sp = get_symbol(ident->name);
+     sp = get_symbol(ident->name, ident->len, ident->hash);
 	 if (NULL == sp) {
 		return;
 	 }
+     if (sp->storage == AutoStorage)
+	  mark_unclean();
+     define_symbol(sp, ident, NULL);
+     if (partial_option)
+	  log_partial_declare(ident);
+     else if (body_log)
+	  log_declare(ident, symbol_decl(sp));
+}
+
+/* Define SP as IDENT, with the declaration text DECL, or with the saved
+   tokens if DECL is NULL */
+static void
+define_symbol(Symbol *sp, Ident *ident, char *decl)
+{
      if (sp->source) {
 	  error_at_line(0, 0, filename, ident->line, 
 			_("%s/%d redefined"),
-			ident->name, sp->arity);
-	  error_at_line(0, 0, sp->source, sp->def_line,
+			sp->name, sp->arity);
+	  error_at_line(0, 0, file_name(sp->source), sp->def_line,
 			_("this is the place of previous definition"));
      }
 
@@ -989,16 +2555,22 @@ declare(Ident *ident)
      sp->arity = ident->parmcnt;
      sp->storage = (ident->storage == ExplicitExternStorage) ?
 	  ExternStorage : ident->storage;
-     sp->decl = finish_save_stack(ident->name);
-     sp->source = filename;
+     if (decl) {
+	  sp->decl.text = decl;
+	  sp->decl_pending = 0;
+     } else
+	  save_decl(sp);
+     sp->source = filename_id;
      sp->def_line = ident->line;
      sp->level = level;
      if (debug)
 	  printf(_("%s:%d: %s/%d defined to %s\n"),
 		 filename,
 		 line_num,
-		 ident->name, ident->parmcnt,
-		 sp->decl);
+		 sp->name, ident->parmcnt,
+		 symbol_decl(sp));
+     if (collect_plan & STREAM_XREF)
+	  xref_definition(sp);
 }
 
 void
@@ -1006,23 +2578,28 @@ declare_type(Ident *ident)
 {
      Symbol *sp;
      
+     mark_unclean();
      undo_save_stack();
-     sp = lookup(ident->name);
+     sp = lookup_hashed(ident->name, ident->len, ident->hash);
      for ( ; sp; sp = sp->next)
 	  if (sp->type == SymToken && sp->token_type == TYPE)
 	       break;
      if (!sp)
-	  sp = install(ident->name);
+	  sp = install_hashed(ident->name, ident->len, ident->hash);
      sp->type = SymToken;
      sp->token_type = TYPE;
-     sp->source = filename;
+     sp->source = filename_id;
      sp->def_line = ident->line;
      sp->ref_line = NULL;
+     if (body_log)
+	  log_ident(ev_type, ident);
      if (debug)
 	  printf(_("%s:%d: type %s\n"),
 		 filename,
 		 line_num,
-		 ident->name);
+		 sp->name);
+     if (collect_plan & STREAM_XREF)
+	  xref_definition(sp);
 }
 
 #define MAX_SYMS 1024
@@ -1033,7 +2610,7 @@ char *sym_array[MAX_SYMS] = {NULL};
 int i = 0;
 FILE *fp;
 
-int cflow_skip_symbols(char* name)
+int cflow_skip_symbols(char* name, int name_len)
 {
 	int len = 1;
 
@@ -1057,7 +2634,7 @@ int cflow_skip_symbols(char* name)
 	 * Linear search of sym_array
 	 */
 	while (len < MAX_SYMS && (NULL != sym_array[len])) {
-		if ( 0 == strncmp(name, sym_array[len], strlen(name)) ) {
+		if ( 0 == strncmp(name, sym_array[len], name_len) ) {
 			return 0;
 		}
 		len++;
@@ -1066,83 +2643,91 @@ int cflow_skip_symbols(char* name)
 }
 
 Symbol *
-get_symbol(char *name)
+get_symbol(char *name, int len, unsigned hash)
 {
-	 if ( 0 == cflow_skip_symbols(name)) {
+	 if ( 0 == cflow_skip_symbols(name, len)) {
 		return NULL;
 	 }
 
-     Symbol *sp;
+     Symbol *sp, *head;
      
-     if (sp = lookup(name)) {
-	  for (; sp; sp = sp->next) {
-	       if (sp->type == SymIdentifier && strcmp(sp->name, name) == 0)
-		    break;
-	  }
+     if ((head = lookup_hashed(name, len, hash)) != NULL) {
+	  sp = find_in_chain(head, SymIdentifier);
 	  if (sp)
 	       return sp;
+	  /* The new symbol will hide the type from the lexer */
+	  if (head->type == SymToken)
+	       mark_unclean();
      }
-     sp = install(name);
+     sp = install_hashed(name, len, hash);
      sp->type = SymIdentifier;
      sp->arity = -1;
      sp->storage = ExternStorage;
-     sp->decl = NULL;
-     sp->source = NULL;
+     sp->decl.text = NULL;
+     sp->source = 0;
      sp->def_line = -1;
      sp->ref_line = NULL;
-     sp->caller = sp->callee = NULL;
      sp->level = -1;
      return sp;
 }
 
 Symbol *
-add_reference(char *name, int line)
+add_reference(char *name, int len, unsigned hash, int line)
 {
-     Symbol *sp = get_symbol(name);
+     Symbol *sp = get_symbol(name, len, hash);
 	 if (NULL == sp) {
 		return NULL;
 	 }
-     Ref *refptr;
-
      if (sp->storage == AutoStorage)
 	  return NULL;
-     refptr = xmalloc(sizeof(*refptr));
-     refptr->source = filename;
-     refptr->line = line;
-     append_to_list(&sp->ref_line, refptr);
+     /* Symbols whose names begin with an underscore are never included
+	in the output without -i _ */
+     if ((collect_plan & COLLECT_REFS)
+	 && (sp->name[0] != '_' || (collect_plan & COLLECT_UNDERSCORE)))
+	  add_ref(&sp->ref_line, filename_id, line);
      return sp;
 }
 
 
-void
-call(char *name, int line)
+Symbol *
+call(char *name, int len, unsigned hash, int line)
 {
      Symbol *sp;
 
-     sp = add_reference(name, line);
+     sp = add_reference(name, len, hash, line);
      if (!sp)
-	  return;
+	  return NULL;
+     if (body_log)
+	  log_reference(ev_call, name, len, hash, line);
      if (sp->arity < 0)
 	  sp->arity = 0;
-     if (caller) {
-	  if (!symbol_in_list(caller, sp->caller))
-	       append_to_list(&sp->caller, caller);
-	  if (!symbol_in_list(sp, caller->callee))
-	       append_to_list(&caller->callee, sp);
+     if (collect_plan & STREAM_XREF)
+	  xref_reference(sp, line);
+     if (caller && (collect_plan & COLLECT_CALLS)) {
+	  if (!symbol_in_list(caller, &sp->caller))
+	       symbol_list_append(&sp->caller, caller);
+	  if (!symbol_in_list(sp, &caller->callee))
+	       symbol_list_append(&caller->callee, sp);
      }
+     return sp;
 }
 
-void
-reference(char *name, int line)
+Symbol *
+reference(char *name, int len, unsigned hash, int line)
 {
-     Symbol *sp = add_reference(name, line);
+     Symbol *sp = add_reference(name, len, hash, line);
      if (!sp)
-	  return;
-     if (caller) {
-	  if (!symbol_in_list(caller, sp->caller))
-	       append_to_list(&sp->caller, caller);
-	  if (!symbol_in_list(sp, caller->callee))
-	       append_to_list(&caller->callee, sp);
+	  return NULL;
+     if (body_log)
+	  log_reference(ev_reference, name, len, hash, line);
+     if (collect_plan & STREAM_XREF)
+	  xref_reference(sp, line);
+     if (caller && (collect_plan & COLLECT_CALLS)) {
+	  if (!symbol_in_list(caller, &sp->caller))
+	       symbol_list_append(&sp->caller, caller);
+	  if (!symbol_in_list(sp, &caller->callee))
+	       symbol_list_append(&caller->callee, sp);
      }
+     return sp;
 }
 
@@ -36,14 +36,30 @@
 #define STRING 271
 #define PARM_WRAPPER 272
 
+/* The text of a token is not copied: STR points into the input buffer
+   and is not NUL-terminated, except for keywords, types and modifiers,
+   for which it is a constant string. LEN is its length in either
+   case. */
 typedef struct {
     char *str;
+    int len;         /* Length of the text */
+    unsigned hash;   /* Hash value of an identifier */
 } YYSTYPE;
 
 extern YYSTYPE yylval;
 extern char *filename;
-extern char *canonical_filename;
+extern int filename_id;
+extern int canonical_filename_id;
 extern int line_num;
+extern long token_offset;
 
 extern int yylex(void);
+extern void set_filename(int id);
+extern void finish_decls(void);
+extern int scan_token(void);
+extern char *read_input(FILE *fp, size_t *size);
+extern void scan_open(void);
+extern void scan_seek(long offset);
+extern void scan_pipeline(void);
+extern void scan_stop(void);
 
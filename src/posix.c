@@ -22,10 +22,12 @@
 static void
 print_symbol_type(FILE *outfile, Symbol *sym)
 {
-     if (sym->decl) 
+     char *decl = symbol_decl(sym);
+     
+     if (decl) 
 	  fprintf(outfile, "%s, <%s %d>",
-		  sym->decl,
-		  sym->source,
+		  decl,
+		  file_name(sym->source),
 		  sym->def_line);
      else
 	  fprintf(outfile, "<>");
@@ -41,7 +43,7 @@ print_symbol(FILE *outfile, int line, struct output_symbol *s)
 	  if (s->sym->expand_line) {
 	       fprintf(outfile, "%d", s->sym->expand_line);
 	       return 1;
-	  } else if (s->sym->callee)
+	  } else if (s->sym->callee.count)
 	       s->sym->expand_line = line;
      }
      print_symbol_type(outfile, s->sym);
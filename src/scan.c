@@ -0,0 +1,922 @@
+/* This file is part of GNU cflow
+   Copyright (C) 1997,2005 Sergey Poznyakoff
+
+   GNU cflow is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   GNU cflow is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with GNU cflow; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301 USA */
+
+/* Hand-written lexical analyzer, used instead of the one generated
+   from c.l when --fast-lexer is given. It scans the input file read
+   into memory by read_input(), which the flex scanner uses as well,
+   and looks for the ends of comments, strings and preprocessor lines
+   16 bytes at a time when SSE2 is available.
+
+   The token stream it produces must be exactly the same as the one
+   produced by yylex(), including line numbers, token offsets and the
+   handling of malformed input. Each branch below names the rule of
+   c.l it stands for. The rules' actions (ident(), update_loc()) are
+   shared: they see the token in yytext and yyleng, which stays
+   NUL-terminated until the next call, as with flex.
+
+   The scanning proper is done by scan_next(), which only looks at the
+   input buffer and its own state, and reports what it has found to
+   scan_token(). The latter runs the actions. With --pipeline,
+   scan_next() runs in a thread of its own, which passes its findings
+   on through a ring buffer. yytext is not NUL-terminated then, since
+   the buffer is being read by the other thread. */
+
+#include <cflow.h>
+#include <parser.h>
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+#ifdef HAVE_PTHREAD_H
+# include <pthread.h>
+# include <sched.h>
+#endif
+
+extern char *yytext;
+extern int yyleng;
+extern long input_offset;
+int ident();
+void update_loc();
+int yywrap();
+
+/* Start conditions, as in c.l */
+enum scan_state {
+     scan_initial,
+     scan_comment,
+     scan_string,
+     scan_stringwait,
+     scan_longline
+};
+
+struct scanner {
+     enum scan_state state;
+     char *cur;            /* Next character to be read */
+     char *bol;            /* A position known to be at the beginning
+			      of a line... */
+     char *nobol;          /* ...and one known not to be */
+     int line;             /* Current line number */
+};
+
+/* What scan_next() has found */
+struct scan_rec {
+     int type;             /* Token, or one of the values below */
+     int line;             /* Line number after it */
+     char *start;          /* Its text */
+     char *end;
+};
+
+/* Other characters are returned as the value of a char, like the `.'
+   rule of c.l does, so these must lie outside the range of char */
+#define SCAN_DIRECTIVE    -256 /* A line directive, for update_loc() */
+#define SCAN_UNTERMINATED -257 /* A newline in a string */
+#define SCAN_EOF          -258 /* End of input. The text of the record,
+				  if any, is to be copied to the standard
+				  output */
+
+static struct scanner scanner;
+static char *buffer;       /* Contents of the current input file */
+static size_t bufsize;     /* Its allocated size */
+static char *end;          /* End of input */
+static char *hold_ptr;     /* Where the NUL terminating yytext is */
+static char hold_char;     /* and what it has replaced */
+static int pipelined;      /* Is scan_next() running in another thread? */
+
+/* The buffer is padded with this many zero bytes, so that one vector
+   can always be loaded, and the characters following the current one
+   examined, without checking for the end of input */
+#define PAD 16
+
+#define AT_BOL(sc, p) \
+ ((p) != (sc)->nobol && ((p) == (sc)->bol || (p)[-1] == '\n'))
+
+
+/* Character classes */
+#define C_BLANK  0x01   /* [ \t\f\r] */
+#define C_ALPHA  0x02   /* [a-zA-Z_] */
+#define C_DIGIT  0x04   /* [0-9] */
+#define C_ODIGIT 0x08   /* [0-7] */
+#define C_XDIGIT 0x10   /* [0-9a-fA-F] */
+
+static unsigned char ctab[256];
+
+#define CLASS(c) ctab[(unsigned char)(c)]
+#define ISBLANK(c) (CLASS(c) & C_BLANK)
+#define ISIDENT(c) (CLASS(c) & (C_ALPHA|C_DIGIT))
+#define ISDIGIT(c) (CLASS(c) & C_DIGIT)
+
+static void
+init_ctab()
+{
+     int c;
+
+     ctab[' '] = ctab['\t'] = ctab['\f'] = ctab['\r'] = C_BLANK;
+     ctab['_'] = C_ALPHA;
+     for (c = 'a'; c <= 'z'; c++)
+	  ctab[c] = C_ALPHA;
+     for (c = 'A'; c <= 'Z'; c++)
+	  ctab[c] = C_ALPHA;
+     for (c = 'a'; c <= 'f'; c++)
+	  ctab[c] |= C_XDIGIT;
+     for (c = 'A'; c <= 'F'; c++)
+	  ctab[c] |= C_XDIGIT;
+     for (c = '0'; c <= '9'; c++)
+	  ctab[c] = C_DIGIT|C_XDIGIT;
+     for (c = '0'; c <= '7'; c++)
+	  ctab[c] |= C_ODIGIT;
+}
+
+
+/* Scanning primitives. Each of them returns the address of the
+   first character in [P, END) it stops at, or END. */
+
+/* Find the first occurrence of A or B */
+static char *
+find2(char *p, int a, int b)
+{
+#ifdef __SSE2__
+     __m128i va = _mm_set1_epi8(a);
+     __m128i vb = _mm_set1_epi8(b);
+
+     for (; p < end; p += 16) {
+	  __m128i x = _mm_loadu_si128((__m128i *) p);
+	  int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, va),
+						    _mm_cmpeq_epi8(x, vb)));
+	  if (mask) {
+	       p += __builtin_ctz(mask);
+	       return p < end ? p : end;
+	  }
+     }
+     return end;
+#else
+     while (p < end && *p != a && *p != b)
+	  p++;
+     return p;
+#endif
+}
+
+/* Find the first occurrence of A, B or C */
+static char *
+find3(char *p, int a, int b, int c)
+{
+#ifdef __SSE2__
+     __m128i va = _mm_set1_epi8(a);
+     __m128i vb = _mm_set1_epi8(b);
+     __m128i vc = _mm_set1_epi8(c);
+
+     for (; p < end; p += 16) {
+	  __m128i x = _mm_loadu_si128((__m128i *) p);
+	  int mask = _mm_movemask_epi8(
+	                _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, va),
+						  _mm_cmpeq_epi8(x, vb)),
+				     _mm_cmpeq_epi8(x, vc)));
+	  if (mask) {
+	       p += __builtin_ctz(mask);
+	       return p < end ? p : end;
+	  }
+     }
+     return end;
+#else
+     while (p < end && *p != a && *p != b && *p != c)
+	  p++;
+     return p;
+#endif
+}
+
+#define find_newline(p) find2(p, '\n', '\n')
+
+/* Skip {WS} */
+static char *
+skip_blanks(char *p)
+{
+#ifdef __SSE2__
+     __m128i sp = _mm_set1_epi8(' ');
+     __m128i tab = _mm_set1_epi8('\t');
+
+     for (;;) {
+	  __m128i x = _mm_loadu_si128((__m128i *) p);
+	  int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, sp),
+						    _mm_cmpeq_epi8(x, tab)));
+	  if (mask != 0xffff) {
+	       p += __builtin_ctz(~mask);
+	       if (!ISBLANK(*p) || p >= end)
+		    break;
+	       p++;
+	  } else
+	       p += 16;
+     }
+     return p < end ? p : end;
+#else
+     while (p < end && ISBLANK(*p))
+	  p++;
+     return p;
+#endif
+}
+
+
+/* Input */
+
+/* Read the whole of FP into memory and return the buffer holding it.
+   Store the number of bytes read in *SIZE. Both lexers scan this
+   buffer, and the text of the tokens they return points into it, so
+   it stays valid until the next file is read. */
+char *
+read_input(FILE *fp, size_t *size)
+{
+     size_t len = 0, n;
+
+     scan_stop();
+     for (;;) {
+	  if (bufsize - len < BUFSIZ + PAD) {
+	       bufsize = bufsize ? 2 * bufsize : 16 * BUFSIZ;
+	       buffer = xrealloc(buffer, bufsize);
+	  }
+	  n = fread(buffer + len, 1, bufsize - len - PAD, fp);
+	  if (n == 0)
+	       break;
+	  len += n;
+     }
+     memset(buffer + len, 0, PAD);
+     end = buffer + len;
+     *size = len;
+     return buffer;
+}
+
+/* Start scanning the buffer filled by read_input(). The start
+   condition is left as is, as yyrestart() does. */
+void
+scan_open()
+{
+     if (!ctab['_'])
+	  init_ctab();
+     scan_stop();
+     scanner.cur = scanner.bol = buffer;
+     scanner.nobol = NULL;
+     hold_ptr = NULL;
+}
+
+/* Continue scanning at OFFSET in the initial start condition */
+void
+scan_seek(long offset)
+{
+     scan_stop();
+     if (hold_ptr) {
+	  *hold_ptr = hold_char;
+	  hold_ptr = NULL;
+     }
+     scanner.cur = offset < end - buffer ? buffer + offset : end;
+     scanner.bol = scanner.cur;
+     scanner.nobol = NULL;
+     scanner.state = scan_initial;
+}
+
+/* Make the text between P and Q the current token */
+static void
+set_text(char *p, char *q)
+{
+     yytext = p;
+     yyleng = q - p;
+     if (pipelined)
+	  return;
+     hold_ptr = q;
+     hold_char = *q;
+     *q = 0;
+}
+
+
+/* Rules */
+
+/* Match {WS}line{WS}{DIGITS} or {WS}{DIGITS} at P */
+static int
+line_directive(char *p)
+{
+     p = skip_blanks(p);
+     if (memcmp(p, "line", 4) == 0)
+	  p = skip_blanks(p + 4);
+     return ISDIGIT(*p);
+}
+
+/* Return the line number set by the directive matched by
+   line_directive(P), as update_loc() computes it */
+static int
+directive_line(char *p)
+{
+     p = skip_blanks(p);
+     if (*p == 'l')
+	  p = skip_blanks(p + 4);
+     return strtoul(p, NULL, 10);
+}
+
+/* Return the token for the keyword of LEN characters at P, 0 if it is
+   not a keyword, or -1 if it is to be ignored */
+static int
+keyword(char *p, size_t len)
+{
+     switch (len) {
+     case 4:
+	  if (memcmp(p, "auto", 4) == 0)
+	       return -1;
+	  if (memcmp(p, "enum", 4) == 0)
+	       return STRUCT;
+	  break;
+     case 5:
+	  if (memcmp(p, "union", 5) == 0)
+	       return STRUCT;
+	  break;
+     case 6:
+	  if (memcmp(p, "extern", 6) == 0)
+	       return EXTERN;
+	  if (memcmp(p, "static", 6) == 0)
+	       return STATIC;
+	  if (memcmp(p, "struct", 6) == 0)
+	       return STRUCT;
+	  break;
+     case 7:
+	  if (memcmp(p, "typedef", 7) == 0)
+	       return TYPEDEF;
+	  break;
+     }
+     return 0;
+}
+
+/* Match a character constant at P:
+     '.' | '\\.' | '\\[0-7]{2,3}' | '\\[xX][0-9a-fA-F]{1,2}'
+   Return the length of the longest match, or 0 */
+static size_t
+char_length(char *p)
+{
+     size_t len = 0;
+     char *q;
+
+     if (p[1] != '\n' && p[2] == '\'')
+	  len = 3;
+     if (p[1] == '\\') {
+	  if (p[2] != '\n' && p[3] == '\'' && p + 3 < end)
+	       len = 4;
+	  for (q = p + 2; q < p + 5 && (CLASS(*q) & C_ODIGIT); q++)
+	       ;
+	  if (q - p >= 4 && *q == '\'')
+	       len = q + 1 - p;
+	  if (p[2] == 'x' || p[2] == 'X') {
+	       for (q = p + 3; q < p + 5 && (CLASS(*q) & C_XDIGIT); q++)
+		    ;
+	       if (q - p >= 4 && *q == '\'' && q + 1 - p > len)
+		    len = q + 1 - p;
+	  }
+     }
+     return len;
+}
+
+/* Skip an optional ([eE][+\-]?{DIGITS}) at P */
+static char *
+exponent(char *p)
+{
+     char *q;
+
+     if (*p == 'e' || *p == 'E') {
+	  q = p + 1;
+	  if (*q == '+' || *q == '-')
+	       q++;
+	  if (ISDIGIT(*q)) {
+	       while (ISDIGIT(*q))
+		    q++;
+	       return q;
+	  }
+     }
+     return p;
+}
+
+/* Match the numeric constant rules at P. Return the length of the
+   longest match, or 0 if none matches. If it is the one of
+   [+\-]?{DNUMBER}[^eE.], whose last character is to be put back, set
+   *TRAIL to 1, otherwise to 0. */
+static size_t
+number_length(char *p, int *trail)
+{
+     size_t len = 0, n;
+     char *s = p, *q;
+
+     *trail = 0;
+     if (*s == '+' || *s == '-')
+	  s++;
+     else if (*s == '0') {
+	  if (s[1] == 'x' || s[1] == 'X') {
+	       /* {HNUMBER} */
+	       for (q = s + 2; CLASS(*q) & C_XDIGIT; q++)
+		    ;
+	  } else {
+	       /* {ONUMBER} */
+	       for (q = s + 1; CLASS(*q) & C_ODIGIT; q++)
+		    ;
+	  }
+	  len = q - p;
+     }
+
+     if (*s >= '1' && *s <= '9') {
+	  /* [+\-]?{DNUMBER}[^eE.] */
+	  for (q = s + 1; ISDIGIT(*q); q++)
+	       ;
+	  if (q < end && *q != 'e' && *q != 'E' && *q != '.')
+	       n = q + 1 - p;
+	  else if (q > s + 1)
+	       n = q - p;
+	  else
+	       n = 0;
+	  if (n > len) {
+	       len = n;
+	       *trail = 1;
+	  }
+     }
+
+     for (q = s; ISDIGIT(*q); q++)
+	  ;
+     if (*q == '.') {
+	  char *r = q + 1;
+
+	  if (ISDIGIT(*r)) {
+	       /* [+\-]?{DIGITS}?\.{DIGITS}([eE][+\-]?{DIGITS})? */
+	       while (ISDIGIT(*r))
+		    r++;
+	       r = exponent(r);
+	  } else if (q > s) 
+	       /* [+\-]?{DIGITS}\.([eE][+\-]?{DIGITS})? */
+	       r = exponent(r);
+	  else
+	       r = p;
+	  if (r - p > len) {
+	       len = r - p;
+	       *trail = 0;
+	  }
+     }
+     return len;
+}
+
+#define lex_error(msg) error_at_line(0, 0, filename, line_num, "%s", msg)
+
+/* Report the text between START and Q as TOK, and continue at Q */
+#define RETURN(tok, q)                            \
+     do {                                         \
+	  rec->type = (tok);                      \
+	  rec->line = sc->line;                   \
+	  rec->start = start;                     \
+	  rec->end = sc->cur = (q);               \
+	  return;                                 \
+     } while (0)
+
+/* Scan the input from SC->cur on, and describe the next token, or
+   anything else scan_token() has to act upon, in REC */
+static void
+scan_next(struct scanner *sc, struct scan_rec *rec)
+{
+     char *p, *q, *start;
+     int c, trail;
+     size_t n;
+
+     p = sc->cur;
+     for (;;) {
+	  switch (sc->state) {
+	  case scan_initial:
+	       break;
+
+	  case scan_comment:
+	       for (;;) {
+		    p = find2(p, '*', '\n');
+		    if (p == end)
+			 goto eof;
+		    if (*p == '\n') {
+			 sc->line++;
+			 p++;
+			 continue;
+		    }
+		    while (*p == '*')
+			 p++;
+		    if (*p == '/') {
+			 /* <comment>"*"+"/" */
+			 sc->state = scan_initial;
+			 p++;
+			 break;
+		    }
+	       }
+	       continue;
+
+	  case scan_string:
+	       for (;;) {
+		    p = find3(p, '"', '\\', '\n');
+		    if (p == end)
+			 goto eof;
+		    if (*p == '"') {
+			 sc->state = scan_stringwait;
+			 p++;
+			 break;
+		    }
+		    if (*p == '\n') {
+			 ++sc->line;
+			 start = ++p;
+			 RETURN(SCAN_UNTERMINATED, p);
+		    }
+		    /* <string>\\. and <string>\\\n */
+		    if (p + 1 == end) 
+			 goto echo;
+		    if (p[1] == '\n')
+			 ++sc->line;
+		    p += 2;
+	       }
+	       continue;
+
+	  case scan_stringwait:
+	       for (;;) {
+		    p = skip_blanks(p);
+		    if (p == end)
+			 goto eof;
+		    if (*p == '\n') {
+			 ++sc->line;
+			 p++;
+			 continue;
+		    }
+		    if (*p == '"') {
+			 sc->state = scan_string;
+			 p++;
+			 break;
+		    }
+		    /* <stringwait>. puts the character back */
+		    sc->state = scan_initial;
+		    start = sc->nobol = p;
+		    RETURN(STRING, p);
+	       }
+	       continue;
+
+	  case scan_longline:
+	       q = find_newline(p);
+	       if (q == end) 
+		    goto echo;
+	       ++sc->line;
+	       if (q == p || q[-1] != '\\')
+		    sc->state = scan_initial;
+	       p = q + 1;
+	       continue;
+	  }
+
+	  if (p == end)
+	       goto eof;
+	  start = p;
+	  c = *p;
+	  switch (c) {
+	  case '\n':
+	       ++sc->line;
+	       p++;
+	       continue;
+
+	  case ' ':
+	  case '\t':
+	  case '\f':
+	  case '\r':
+	  case '#':
+	       q = skip_blanks(p);
+	       if (*q == '#' && q < end) {
+		    char *nl = find_newline(q);
+
+		    if (nl < end) {
+			 if (AT_BOL(sc, p) && line_directive(q + 1)) {
+			      /* ^{WS}#{WS}line{WS}{DIGITS}.*\n and
+				 ^{WS}#{WS}{DIGITS}.*\n */
+			      sc->line = directive_line(q + 1);
+			      RETURN(SCAN_DIRECTIVE, nl + 1);
+			 }
+			 /* ^{WS}#.*\\\n and {WS}#.*\n */
+			 if (AT_BOL(sc, p) && nl[-1] == '\\')
+			      sc->state = scan_longline;
+			 ++sc->line;
+			 p = nl + 1;
+			 continue;
+		    }
+	       }
+	       if (q == p)
+		    RETURN(c, p + 1);
+	       p = q;
+	       continue;
+
+	  case '{':
+	       RETURN(AT_BOL(sc, p) ? LBRACE0 : c, p + 1);
+
+	  case '}':
+	       RETURN(AT_BOL(sc, p) ? RBRACE0 : c, p + 1);
+
+	  case '"':
+	       sc->state = scan_string;
+	       p++;
+	       continue;
+
+	  case '\'':
+	       if ((n = char_length(p)) != 0)
+		    RETURN(STRING, p + n);
+	       RETURN(c, p + 1);
+
+	  case '/':
+	       if (p[1] == '/') {
+		    q = find_newline(p + 2);
+		    if (q < end) {
+			 ++sc->line;
+			 p = q + 1;
+			 continue;
+		    }
+	       } else if (p[1] == '*') {
+		    sc->state = scan_comment;
+		    p += 2;
+		    continue;
+	       } else if (p[1] == '=')
+		    RETURN(OP, p + 2);
+	       RETURN(c, p + 1);
+
+	  case '*':
+	       if (p[1] == '=')
+		    RETURN(OP, p + 2);
+	       RETURN(MODIFIER, p + 1);
+
+	  case '%':
+	  case '^':
+	  case '!':
+	  case '=':
+	       if (p[1] == '=')
+		    RETURN(OP, p + 2);
+	       RETURN(c, p + 1);
+
+	  case '&':
+	  case '|':
+	       if (p[1] == c || p[1] == '=')
+		    RETURN(OP, p + 2);
+	       RETURN(c, p + 1);
+
+	  case '<':
+	  case '>':
+	       if (p[1] == c)
+		    RETURN(OP, p + (p[2] == '=' ? 3 : 2));
+	       RETURN(OP, p + (p[1] == '=' ? 2 : 1));
+
+	  case '+':
+	  case '-':
+	       if ((n = number_length(p, &trail)) != 0)
+		    goto number;
+	       if (p[1] == c || p[1] == '=')
+		    RETURN(OP, p + 2);
+	       if (c == '-' && p[1] == '>')
+		    RETURN(MEMBER_OF, p + 2);
+	       RETURN(c, p + 1);
+
+	  case '.':
+	       if (p[1] == '.' && p[2] == '.') {
+		    q = p + 3;
+		    goto identifier;
+	       }
+	       if ((n = number_length(p, &trail)) != 0)
+		    goto number;
+	       RETURN(MEMBER_OF, p + 1);
+
+	  case '0':
+	  case '1':
+	  case '2':
+	  case '3':
+	  case '4':
+	  case '5':
+	  case '6':
+	  case '7':
+	  case '8':
+	  case '9':
+	       if ((n = number_length(p, &trail)) != 0)
+		    goto number;
+	       RETURN(c, p + 1);
+
+	  default:
+	       if (!(CLASS(c) & C_ALPHA))
+		    RETURN(c, p + 1);
+	       for (q = p + 1; ISIDENT(*q); q++)
+		    ;
+	       c = keyword(p, q - p);
+	       if (c < 0) {
+		    p = q;
+		    continue;
+	       } else if (c)
+		    RETURN(c, q);
+	       goto identifier;
+	  }
+
+     number:
+	  RETURN(WORD, p + n - trail);
+
+     identifier:
+	  RETURN(IDENTIFIER, q);
+     }
+
+ echo:
+     /* The text no rule matches is copied to the standard output, as
+	the default rule of flex does */
+     start = p;
+     RETURN(SCAN_EOF, end);
+     
+ eof:
+     start = end;
+     RETURN(SCAN_EOF, end);
+}
+
+
+/* Pipelined scanning */
+
+#ifdef HAVE_PTHREAD_H
+/* The ring buffer through which the scanner thread passes the records
+   to scan_token(). Each of the indices is written by one thread only,
+   and is kept on a cache line of its own. */
+#define RING_SIZE 1024
+
+static struct scan_rec ring[RING_SIZE];
+static struct {
+     unsigned long head;   /* Records written by the scanner thread */
+     char pad1[64 - sizeof(unsigned long)];
+     unsigned long tail;   /* Records read by scan_token() */
+     char pad2[64 - sizeof(unsigned long)];
+     int stop;             /* Tells the scanner thread to stop */
+} ring_index;
+static unsigned long ring_head; /* Value of ring_index.head last seen by
+				   scan_token() */
+static struct scanner ring_scanner; /* State of the scanner thread */
+static pthread_t scanner_thread;
+
+static void *
+scanner_main(void *arg)
+{
+     struct scan_rec *rec;
+     unsigned long head = 0, tail = 0;
+     int type;
+
+     do {
+	  while (head - tail == RING_SIZE) {
+	       tail = __atomic_load_n(&ring_index.tail, __ATOMIC_ACQUIRE);
+	       if (head - tail < RING_SIZE)
+		    break;
+	       if (__atomic_load_n(&ring_index.stop, __ATOMIC_RELAXED))
+		    return NULL;
+	       sched_yield();
+	  }
+	  rec = &ring[head % RING_SIZE];
+	  scan_next(&ring_scanner, rec);
+	  type = rec->type;
+	  __atomic_store_n(&ring_index.head, ++head, __ATOMIC_RELEASE);
+     } while (type != SCAN_EOF);
+     return NULL;
+}
+
+static void
+ring_get(struct scan_rec *rec)
+{
+     unsigned long tail = ring_index.tail;
+
+     while (tail == ring_head) {
+	  ring_head = __atomic_load_n(&ring_index.head, __ATOMIC_ACQUIRE);
+	  if (tail != ring_head)
+	       break;
+	  sched_yield();
+     }
+     *rec = ring[tail % RING_SIZE];
+     __atomic_store_n(&ring_index.tail, tail + 1, __ATOMIC_RELEASE);
+}
+#endif
+
+/* Go on scanning the buffer in a thread of its own, if possible */
+void
+scan_pipeline()
+{
+#ifdef HAVE_PTHREAD_H
+     if (pipelined)
+	  return;
+     ring_scanner = scanner;
+     ring_scanner.line = line_num;
+     ring_index.head = ring_index.tail = ring_head = 0;
+     ring_index.stop = 0;
+     if (pthread_create(&scanner_thread, NULL, scanner_main, NULL) == 0)
+	  pipelined = 1;
+#endif
+}
+
+/* Stop the scanner thread, if there is one, and take its state over */
+void
+scan_stop()
+{
+#ifdef HAVE_PTHREAD_H
+     if (!pipelined)
+	  return;
+     __atomic_store_n(&ring_index.stop, 1, __ATOMIC_RELAXED);
+     pthread_join(scanner_thread, NULL);
+     scanner = ring_scanner;
+     pipelined = 0;
+#endif
+}
+
+
+/* Actions */
+
+static void
+next_rec(struct scan_rec *rec)
+{
+#ifdef HAVE_PTHREAD_H
+     if (pipelined) {
+	  ring_get(rec);
+	  if (rec->type == SCAN_EOF)
+	       scan_stop();
+	  return;
+     }
+#endif
+     scanner.line = line_num;
+     scan_next(&scanner, rec);
+}
+
+/* Make the line directive between P and Q the current token. It must
+   be NUL-terminated for update_loc(), so it is copied if the buffer
+   cannot be written to. */
+static void
+set_directive(char *p, char *q)
+{
+     static char *text;
+     static size_t size;
+
+     if (!pipelined) {
+	  set_text(p, q);
+	  return;
+     }
+     if (q - p >= size) {
+	  size = q - p + 1;
+	  text = xrealloc(text, size);
+     }
+     memcpy(text, p, q - p);
+     text[q - p] = 0;
+     yytext = text;
+     yyleng = q - p;
+}
+
+int
+scan_token()
+{
+     struct scan_rec rec;
+     int type;
+
+     for (;;) {
+	  if (hold_ptr) {
+	       *hold_ptr = hold_char;
+	       hold_ptr = NULL;
+	  }
+	  next_rec(&rec);
+	  line_num = rec.line;
+	  switch (rec.type) {
+	  case SCAN_DIRECTIVE:
+	       set_directive(rec.start, rec.end);
+	       update_loc();
+	       continue;
+	       
+	  case SCAN_UNTERMINATED:
+	       lex_error(_("unterminated string?"));
+	       continue;
+
+	  case SCAN_EOF:
+	       fwrite(rec.start, 1, rec.end - rec.start, stdout);
+	       yywrap();
+	       return 0;
+	  }
+
+	  token_offset = rec.start - buffer;
+	  input_offset = rec.end - buffer;
+	  switch (type = rec.type) {
+	  case WORD:
+	       set_text(rec.start, rec.end);
+	       yylval.str = yytext;
+	       yylval.len = yyleng;
+	       break;
+
+	  case IDENTIFIER:
+	       set_text(rec.start, rec.end);
+	       type = ident();
+	       break;
+	       
+	  case STRUCT:
+	       yylval.str = rec.start[0] == 'e' ? "enum"
+		              : rec.start[0] == 'u' ? "union" : "struct";
+	       yylval.len = rec.end - rec.start;
+	       break;
+
+	  case MODIFIER:
+	       yylval.str = "*";
+	       yylval.len = 1;
+	       break;
+	  }
+	  return type;
+     }
+}
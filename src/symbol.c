@@ -20,69 +20,508 @@
 #include <parser.h>
 #include <hash.h>
 
-Hash_table *symbol_table;
+/* String interning. Tokens only point into the input buffer; their
+   text is copied out when it has to outlive the buffer, i.e. when it
+   becomes a symbol name or a file name. Each distinct string is
+   copied once. */
 
-/* Calculate the hash of a string.  */
-static unsigned
-hash_symbol_hasher(void const *data, unsigned n_buckets)
+struct string {
+     unsigned hash;
+     size_t len;
+     char *text;
+     int file;              /* File table id, if the string is the name
+			       of a file, 0 otherwise */
+};
+
+static Hash_table *string_table;
+static struct obstack string_stk;
+
+static size_t
+hash_string_hasher(void const *data, size_t n_buckets)
 {
-     Symbol const *sym = data;
-     return hash_string(sym->name, n_buckets);
+     struct string const *sp = data;
+     return sp->hash % n_buckets;
 }
 
-/* Compare two strings for equality.  */
 static bool
-hash_symbol_compare(void const *data1, void const *data2)
+hash_string_compare(void const *data1, void const *data2)
+{
+     struct string const *s1 = data1;
+     struct string const *s2 = data2;
+     return s1->hash == s2->hash
+	    && s1->len == s2->len
+	    && memcmp(s1->text, s2->text, s1->len) == 0;
+}
+
+static struct string *
+intern_entry(const char *text, size_t len, unsigned hash)
+{
+     struct string key, *sp;
+
+     if (!string_table) {
+	  obstack_init(&string_stk);
+	  string_table = hash_initialize(0, 0,
+					 hash_string_hasher,
+					 hash_string_compare, 0);
+	  if (!string_table)
+	       xalloc_die();
+     }
+     key.hash = hash;
+     key.len = len;
+     key.text = (char *) text;
+     sp = hash_lookup(string_table, &key);
+     if (sp)
+	  return sp;
+
+     sp = obstack_alloc(&string_stk, sizeof(*sp));
+     sp->hash = hash;
+     sp->len = len;
+     sp->file = 0;
+     obstack_grow(&string_stk, text, len);
+     obstack_1grow(&string_stk, 0);
+     sp->text = obstack_finish(&string_stk);
+     if (!hash_insert(string_table, sp))
+	  xalloc_die();
+     return sp;
+}
+
+/* Return the interned copy of the LEN characters at TEXT, whose hash
+   value, as computed by name_hash(), is HASH */
+char *
+intern(const char *text, size_t len, unsigned hash)
+{
+     return intern_entry(text, len, hash)->text;
+}
+
+/* Same as intern(), for the NUL-terminated STR */
+char *
+intern_string(const char *str)
+{
+     size_t len = strlen(str);
+     return intern(str, len, name_hash(str, len));
+}
+
+/* File table. Symbols and references keep the small integer id of
+   their source file instead of its name. Id 0 means no file. */
+static char **file_tab;
+static int file_count;
+static int file_max;
+
+/* Return the id of the file named by the LEN characters at NAME, whose
+   hash value is HASH, assigning a new one if necessary */
+int
+file_id(const char *name, size_t len, unsigned hash)
+{
+     struct string *sp = intern_entry(name, len, hash);
+
+     if (sp->file == 0) {
+	  if (file_count + 1 >= file_max) {
+	       file_max = file_max ? 2 * file_max : 64;
+	       file_tab = xrealloc(file_tab, file_max * sizeof(*file_tab));
+	  }
+	  file_tab[++file_count] = sp->text;
+	  sp->file = file_count;
+     }
+     return sp->file;
+}
+
+/* Return the name of the file with the given ID, or NULL if ID is 0 */
+char *
+file_name(int id)
+{
+     return id ? file_tab[id] : NULL;
+}
+
+/* Compute the hash value of the LEN characters of TEXT. It is
+   computed once for each identifier read and kept in the symbol, so
+   that neither lookups nor table resizes have to rehash the name. */
+unsigned
+name_hash(const char *text, size_t len)
+{
+     unsigned hash = 0;
+
+     while (len--)
+	  hash = hash * 31 + *(unsigned char *)text++;
+     return hash;
+}
+
+
+/* The symbol table. Symbols with the same name are chained through
+ * their `next' member, and only the heads of the chains are kept, in
+ * the dense array symbol_heads, in the order they were added. Full
+ * table walks go over that array, so their cost does not depend on
+ * the size of the index.
+ *
+ * The index is open-addressed, with linear probing and robin hood
+ * insertion: an entry that is farther from its home slot takes the
+ * place of one that is nearer, so that probe sequences stay short and
+ * a lookup can stop as soon as it meets an entry that is closer to its
+ * home than the name being looked up would be. Each slot keeps the
+ * hash value of its name, so that most mismatches are detected
+ * without touching the symbol itself.
+ */
+struct symbol_slot {
+     unsigned hash;                /* Hash value of the name */
+     unsigned index;               /* 1 + index in symbol_heads, 0 if the
+				      slot is free */
+};
+
+static struct symbol_slot *symbol_table;
+static size_t symbol_table_size;   /* Number of slots, a power of 2 */
+static Symbol **symbol_heads;
+static size_t head_count;
+static size_t head_max;
+
+#define SYMBOL_TABLE_MIN 1024
+#define SLOT_SYMBOL(slot) symbol_heads[(slot)->index - 1]
+/* Distance of the slot I from the home slot of hash value H */
+#define SLOT_DIST(i, h) (((i) - (h)) & (symbol_table_size - 1))
+
+/* Put SLOT into the index, which must have a free slot */
+static void
+place_slot(struct symbol_slot slot)
+{
+     struct symbol_slot tmp;
+     size_t mask = symbol_table_size - 1;
+     size_t i, dist, d;
+
+     for (i = slot.hash & mask, dist = 0; ; i = (i + 1) & mask, dist++) {
+	  if (!symbol_table[i].index) {
+	       symbol_table[i] = slot;
+	       return;
+	  }
+	  d = SLOT_DIST(i, symbol_table[i].hash);
+	  if (d < dist) {
+	       tmp = symbol_table[i];
+	       symbol_table[i] = slot;
+	       slot = tmp;
+	       dist = d;
+	  }
+     }
+}
+
+static void
+resize_symbol_table(size_t size)
+{
+     struct symbol_slot *old = symbol_table;
+     size_t i, old_size = symbol_table_size;
+
+     symbol_table = xcalloc(size, sizeof(*symbol_table));
+     symbol_table_size = size;
+     for (i = 0; i < old_size; i++)
+	  if (old[i].index)
+	       place_slot(old[i]);
+     free(old);
+}
+
+/* Make room in the symbol table for COUNT more names */
+void
+reserve_symbols(size_t count)
+{
+     size_t size = symbol_table_size ? symbol_table_size : SYMBOL_TABLE_MIN;
+     
+     count += head_count;
+     while (count * 4 > size * 3)
+	  size *= 2;
+     if (size != symbol_table_size)
+	  resize_symbol_table(size);
+     if (count > head_max) {
+	  head_max = count > 2 * head_max ? count : 2 * head_max;
+	  symbol_heads = xrealloc(symbol_heads,
+				  head_max * sizeof(*symbol_heads));
+     }
+}
+
+/* Return the slot of the name of LEN characters at NAME, whose hash
+   value is HASH, or NULL if there is none */
+static struct symbol_slot *
+find_slot(const char *name, size_t len, unsigned hash)
+{
+     struct symbol_slot *slot;
+     Symbol *sym;
+     size_t mask, i, dist;
+
+     if (!head_count)
+	  return NULL;
+     mask = symbol_table_size - 1;
+     for (i = hash & mask, dist = 0; ; i = (i + 1) & mask, dist++) {
+	  slot = &symbol_table[i];
+	  if (!slot->index || SLOT_DIST(i, slot->hash) < dist)
+	       return NULL;
+	  if (slot->hash == hash) {
+	       sym = SLOT_SYMBOL(slot);
+	       if (sym->len == len && memcmp(sym->name, name, len) == 0)
+		    return slot;
+	  }
+     }
+}
+
+/* Add SYM, whose name is not in the table yet */
+static void
+insert_slot(Symbol *sym)
+{
+     struct symbol_slot slot;
+
+     reserve_symbols(1);
+     symbol_heads[head_count++] = sym;
+     slot.hash = sym->hash;
+     slot.index = head_count;
+     place_slot(slot);
+}
+
+/* Remove the name in SLOT from the table */
+static void
+delete_slot(struct symbol_slot *slot)
 {
-     Symbol const *s1 = data1;
-     Symbol const *s2 = data2;
-     return strcmp(s1->name, s2->name) == 0;
+     size_t mask = symbol_table_size - 1;
+     size_t i = slot - symbol_table, next;
+     size_t index = slot->index;
+     Symbol *last;
+
+     for (next = (i + 1) & mask;
+	  symbol_table[next].index
+	       && SLOT_DIST(next, symbol_table[next].hash);
+	  i = next, next = (next + 1) & mask)
+	  symbol_table[i] = symbol_table[next];
+     symbol_table[i].index = 0;
+
+     /* Move the last head into the freed place */
+     if (index != head_count) {
+	  last = symbol_heads[head_count - 1];
+	  find_slot(last->name, last->len, last->hash)->index = index;
+	  symbol_heads[index - 1] = last;
+     }
+     head_count--;
+}
+
+/* Call PROC for the head of each chain in the table, until it returns
+   false */
+static void
+for_each_symbol(bool (*proc)(void *, void *), void *data)
+{
+     size_t i;
+
+     for (i = 0; i < head_count; i++)
+	  if (!proc(symbol_heads[i], data))
+	       break;
+}
+
+/* Look up the name of LEN characters at NAME, whose hash value is
+   HASH. NAME need not be NUL-terminated. */
+Symbol *
+lookup_hashed(char *name, size_t len, unsigned hash)
+{
+     struct symbol_slot *slot = find_slot(name, len, hash);
+     return slot ? SLOT_SYMBOL(slot) : NULL;
+}
+
+/* Symbols are allocated in blocks, so that they lie close together in
+   memory, and deleted symbols are reused */
+#define SYMBOL_BLOCK 512
+static Symbol *free_symbols;       /* Chained through `next' */
+static Symbol **symbol_blocks;
+static size_t symbol_block_count;
+static size_t symbol_block_free;   /* Number of unused symbols in the
+				      last block */
+
+static Symbol *
+alloc_symbol()
+{
+     Symbol *sym;
+
+     if (free_symbols) {
+	  sym = free_symbols;
+	  free_symbols = sym->next;
+     } else {
+	  if (symbol_block_free == 0) {
+	       symbol_blocks = xrealloc(symbol_blocks,
+					(symbol_block_count + 1)
+					* sizeof(*symbol_blocks));
+	       symbol_blocks[symbol_block_count++] =
+		    xmalloc(SYMBOL_BLOCK * sizeof(Symbol));
+	       symbol_block_free = SYMBOL_BLOCK;
+	  }
+	  sym = &symbol_blocks[symbol_block_count - 1]
+	                      [SYMBOL_BLOCK - symbol_block_free--];
+     }
+     memset(sym, 0, sizeof(*sym));
+     return sym;
+}
+
+static void
+free_symbol(Symbol *sym)
+{
+     sym->decl_pending = 0;
+     sym->scratch_name = 0;
+     sym->next = free_symbols;
+     free_symbols = sym;
+}
+
+/* Set the `included' bit of every symbol ever allocated to the value
+   returned by SEL. This covers the symbols that are no longer in the
+   table but can still be reached through the caller and callee lists. */
+void
+mark_symbols(int (*sel)(Symbol *))
+{
+     size_t i, j, n;
+
+     for (i = 0; i < symbol_block_count; i++) {
+	  n = i + 1 < symbol_block_count ?
+	       SYMBOL_BLOCK : SYMBOL_BLOCK - symbol_block_free;
+	  for (j = 0; j < n; j++)
+	       symbol_blocks[i][j].included = sel(&symbol_blocks[i][j]) != 0;
+     }
+}
+
+/* Return the innermost symbol of the given TYPE in the chain starting
+   at HEAD, or NULL if there is none. All the symbols in a chain have
+   the same name, so only their types need to be compared. The walk is
+   short: install() puts new symbols in front of the chain, so the
+   innermost identifier is preceded at most by the tokens (keywords and
+   typedefs) of the same name, and a name has at most one typedef
+   symbol (see declare_type). */
+Symbol *
+find_in_chain(Symbol *head, enum symtype type)
+{
+     for (; head; head = head->next)
+	  if (head->type == type)
+	       break;
+     return head;
 }
 
 Symbol *
 lookup(char *name)
 {
-     Symbol s;
-     if (!symbol_table)
-	  return NULL;
-     s.name = name;
-     return hash_lookup(symbol_table, &s);
+     size_t len = strlen(name);
+     return lookup_hashed(name, len, name_hash(name, len));
 }
 
+/* The names of the symbols installed while a source file is being read
+   are kept in scratch_stk, which is emptied at the end of the file (see
+   reset_scratch). Most of them are gone by then, together with the
+   local variables, parameters and static symbols they named. The names
+   of the symbols that remain are moved to the string table first.
+   scratch_syms keeps the addresses of the symbols that may have got a
+   scratch name, either when installed or when moved. */
+static struct obstack scratch_stk;
+static int scratch_init;
+static char *scratch_first;     /* First name in scratch_stk */
+static Symbol **scratch_syms;
+static size_t scratch_count;
+static size_t scratch_max;
+
+static char *
+scratch_name(const char *name, size_t len)
+{
+     char *p;
+     
+     if (!scratch_init) {
+	  obstack_init(&scratch_stk);
+	  scratch_init = 1;
+     }
+     p = obstack_copy0(&scratch_stk, name, len);
+     if (!scratch_first)
+	  scratch_first = p;
+     return p;
+}
+
+static void
+scratch_symbol(Symbol *sym)
+{
+     if (scratch_count == scratch_max) {
+	  scratch_max = scratch_max ? 2 * scratch_max : 1024;
+	  scratch_syms = xrealloc(scratch_syms,
+				  scratch_max * sizeof(*scratch_syms));
+     }
+     scratch_syms[scratch_count++] = sym;
+}
+
+/* Intern the scratch names of the symbols still alive and empty the
+   scratch area. Called at the end of each source file. */
+void
+reset_scratch()
+{
+     size_t i;
+     Symbol *sym;
+
+     for (i = 0; i < scratch_count; i++) {
+	  sym = scratch_syms[i];
+	  if (sym->scratch_name) {
+	       sym->name = intern(sym->name, sym->len, sym->hash);
+	       sym->scratch_name = 0;
+	  }
+     }
+     scratch_count = 0;
+     if (scratch_first) {
+	  obstack_free(&scratch_stk, scratch_first);
+	  scratch_first = NULL;
+     }
+}
+
+/* Tell the pending declaration and the deferred bodies of SYM, if
+   any, that the symbol has been moved to SYM */
+static void
+moved_symbol(Symbol *sym)
+{
+     if (sym->decl_pending)
+	  sym->decl.pending->owner = sym;
+     if (sym->body)
+	  moved_bodies(sym);
+}
+
+/* Install the name of LEN characters at NAME, whose hash value is
+   HASH. The symbol gets an interned copy of the name. */
 Symbol *
-install(char *name)
+install_hashed(char *name, size_t len, unsigned hash)
 {
      Symbol *sym, *s;
+     struct symbol_slot *slot;
 
-     sym = xmalloc(sizeof(*sym));
-     memset(sym, 0, sizeof(*sym));
+     sym = alloc_symbol();
      sym->type = SymUndefined;
-     sym->name = name;
+     sym->name = scratch_name(name, len);
+     sym->scratch_name = 1;
+     sym->len = len;
+     sym->hash = hash;
+     scratch_symbol(sym);
 
-     if (canonical_filename && strcmp(filename, canonical_filename))
+     if (canonical_filename_id && filename_id != canonical_filename_id)
 	  sym->flag = symbol_temp;
      else
 	  sym->flag = symbol_none;
      
-     if (! ((symbol_table
-	     || (symbol_table = hash_initialize (0, 0, 
-						 hash_symbol_hasher,
-						 hash_symbol_compare, 0)))
-	    && (s = hash_insert (symbol_table, sym))))
-	  xalloc_die ();
-
-     if (s != sym) {
+     slot = find_slot(name, len, hash);
+     if (!slot)
+	  insert_slot(sym);
+     else {
+	  s = SLOT_SYMBOL(slot);
+	  /* The lists of other symbols keep pointing to S, so S stays
+	     linked */
+	  sym->linked = s->linked;
 	  if (s->type == SymUndefined) {
+	       symbol_list_free(&s->caller);
+	       symbol_list_free(&s->callee);
 	       *s = *sym;
-	       free(sym);
+	       free_symbol(sym);
 	  } else {
 	       Symbol tmp = *s;
 	       *s = *sym;
 	       *sym = tmp;
+	       sym->linked = 0;
+	       moved_symbol(sym);
 	       s->next = sym;
 	  }
+	  scratch_symbol(s);
+	  return s;
      }
-     return s;
+     return sym;
+}
+
+Symbol *
+install(char *name)
+{
+     size_t len = strlen(name);
+     return install_hashed(name, len, name_hash(name, len));
 }
 
 static void
@@ -90,8 +529,12 @@ delete_symbol(Symbol *s)
 {
      Symbol *next = s->next;
      if (next) {
+	  next->linked = s->linked;
 	  *s = *next;
-	  free(next);
+	  moved_symbol(s);
+	  if (s->scratch_name)
+	       scratch_symbol(s);
+	  free_symbol(next);
      } else {
 	  s->type = SymUndefined;
      }
@@ -123,14 +566,56 @@ temp_processor(void *data, void *proc_data)
      return true;
 }
 
+/* A symbol deleted by delete_symbol() stays in the table as undefined
+   when it is the only one with its name, because the caller and callee
+   lists of other symbols may point to it. Those that were never put on
+   a list are taken out of the table and freed, so that the table does
+   not grow with the names of the local variables and parameters of
+   every source file read so far. The lists are not symmetric: a symbol
+   may be on the lists of others after its own were dropped, so only
+   the linked bit tells whether it is still referred to. */
+static void free_ref_list(struct ref_list *list);
+static void check_memory(void);
+
+static int
+unused_symbol(Symbol *sym)
+{
+     return sym->type == SymUndefined
+	    && !sym->next
+	    && !sym->linked;
+}
+
+static void
+sweep_symbols()
+{
+     size_t i = 0;
+     Symbol *sym;
+
+     while (i < head_count) {
+	  sym = symbol_heads[i];
+	  if (unused_symbol(sym)) {
+	       /* The last head takes its place */
+	       delete_slot(find_slot(sym->name, sym->len, sym->hash));
+	       symbol_list_free(&sym->caller);
+	       symbol_list_free(&sym->callee);
+	       free_ref_list(sym->ref_line);
+	       free_symbol(sym);
+	  } else
+	       i++;
+     }
+}
+
 void
 delete_statics()
 {
      if (globals_only()) 
-	  hash_do_for_each (symbol_table, static_processor, NULL);
-     hash_do_for_each (symbol_table, temp_processor, NULL);
+	  for_each_symbol(static_processor, NULL);
+     for_each_symbol(temp_processor, NULL);
+     sweep_symbols();
+     check_memory();
 }
 
+
 /* See NOTE above */
 bool
 auto_processor(void *data, void *proc_data)
@@ -148,45 +633,16 @@ auto_processor(void *data, void *proc_data)
 void
 delete_autos(int level)
 {
-     hash_do_for_each (symbol_table, auto_processor, &level);
+     for_each_symbol(auto_processor, &level);
 }
 
 
-/* Make all list pointers of the SYM ready for final processing.
- * This means for each list replace its entry point with its CAR
- * and throw away the first cons. The first cons holds pointers
- * to the head and tail of the list and is used to speed up appends.
- *  
- * TODO: The memory is not reclaimed
- */
-static bool
-cleanup_processor(void *data, void *proc_data)
-{
-     Symbol *sym;
-
-     for (sym = data; sym; sym = sym->next) {
-	  if (sym->type == SymIdentifier) {
-	       if (sym->ref_line)
-		    sym->ref_line = CAR(sym->ref_line);
-	       if (sym->caller)
-		    sym->caller = CAR(sym->caller);
-	       if (sym->callee)
-		    sym->callee = CAR(sym->callee);
-	  }
-     }
-     return true;
-}
-
-
 /* Clean up all symbols from the auxiliary information.
- * See the comment for cleanup_symbol() above
  */
 extern char* sym_array[];
 void
 cleanup()
 {
-     hash_do_for_each (symbol_table, cleanup_processor, NULL);
-
 	 int i = 0;
 	 if (sym_array) {
 		while(sym_array[i]) {
@@ -200,6 +656,7 @@ struct collect_data {
      Symbol **sym;
      int (*sel)(Symbol *p);
      size_t index;
+     size_t max;
 };
 
 static bool
@@ -209,14 +666,19 @@ collect_processor(void *data, void *proc_data)
      struct collect_data *cd = proc_data;
      for (s = data; s; s = s->next) {
 	  if (cd->sel(s)) {
-	       if (cd->sym)
-		    cd->sym[cd->index] = s;
-	       cd->index++;
+	       if (cd->index == cd->max) {
+		    cd->max = cd->max ? 2 * cd->max : 1024;
+		    cd->sym = xrealloc(cd->sym, cd->max * sizeof(*cd->sym));
+	       }
+	       cd->sym[cd->index++] = s;
 	  }
      }
      return true;
 }
 
+/* Store in *RETURN_SYM the symbols for which SEL returns true, and
+   return their number. The table is walked only once: the array
+   grows as needed. */
 int
 collect_symbols(Symbol ***return_sym, int (*sel)(Symbol *p))
 {
@@ -224,17 +686,82 @@ collect_symbols(Symbol ***return_sym, int (*sel)(Symbol *p))
 
      cdata.sym = NULL;
      cdata.index = 0;
+     cdata.max = 0;
      cdata.sel = sel;
-     hash_do_for_each (symbol_table, collect_processor, &cdata);
-     cdata.sym = calloc(cdata.index, sizeof(*cdata.sym));
-     if (!cdata.sym)
-	  xalloc_die();
-     cdata.index = 0;
-     hash_do_for_each (symbol_table, collect_processor, &cdata);
+     for_each_symbol(collect_processor, &cdata);
      *return_sym = cdata.sym;
      return cdata.index;
 }
 
+
+/* Lazy mode support. File-scope symbols, i.e. statics and temporary
+   symbols, are taken out of the symbol table at the end of each source
+   file and put back while the function bodies from that file are being
+   parsed. Unlike delete_symbol(), these functions keep the Symbol
+   structures in place, since they may be referenced from elsewhere. */
+
+static int
+unit_symbol(Symbol *s)
+{
+     return s->type != SymUndefined
+	    && (s->flag == symbol_temp
+		|| (s->type == SymIdentifier && s->storage == StaticStorage));
+}
+
+static void
+unlink_symbol(Symbol *sym)
+{
+     struct symbol_slot *slot = find_slot(sym->name, sym->len, sym->hash);
+     Symbol *s = SLOT_SYMBOL(slot);
+
+     if (s == sym) {
+	  if (sym->next)
+	       SLOT_SYMBOL(slot) = sym->next;
+	  else
+	       delete_slot(slot);
+     } else {
+	  for (; s->next != sym; s = s->next)
+	       ;
+	  s->next = sym->next;
+     }
+     sym->next = NULL;
+}
+
+static void
+link_symbol(Symbol *sym)
+{
+     struct symbol_slot *slot = find_slot(sym->name, sym->len, sym->hash);
+
+     if (slot) {
+	  sym->next = SLOT_SYMBOL(slot);
+	  SLOT_SYMBOL(slot) = sym;
+     } else {
+	  sym->next = NULL;
+	  insert_slot(sym);
+     }
+}
+
+/* Remove all file-scope symbols from the symbol table. Return their
+   number, and the symbols themselves in *RETURN_SYM. */
+size_t
+detach_unit_symbols(Symbol ***return_sym)
+{
+     size_t i, num;
+
+     num = collect_symbols(return_sym, unit_symbol);
+     for (i = 0; i < num; i++)
+	  unlink_symbol((*return_sym)[i]);
+     return num;
+}
+
+/* Put back NUM symbols, previously removed by detach_unit_symbols() */
+void
+attach_symbols(Symbol **sym, size_t num)
+{
+     while (num--)
+	  link_symbol(sym[num]);
+}
+
 
 /* Special handling for function parameters */
 
@@ -253,7 +780,7 @@ delete_parm_processor(void *data, void *proc_data)
 void
 delete_parms(int level)
 {
-     hash_do_for_each (symbol_table, delete_parm_processor, &level);
+     for_each_symbol(delete_parm_processor, &level);
 }
 
 static bool
@@ -274,7 +801,36 @@ move_parm_processor(void *data, void *proc_data)
 void
 move_parms(int level)
 {
-     hash_do_for_each (symbol_table, move_parm_processor, &level);
+     for_each_symbol(move_parm_processor, &level);
+}
+
+static bool
+parm_name_processor(void *data, void *proc_data)
+{
+     Symbol *s = data;
+     if (s->type == SymIdentifier && s->storage == AutoStorage
+	 && s->flag == symbol_parm)
+	  obstack_ptr_grow((struct obstack *)proc_data,
+			   s->scratch_name ?
+			     intern(s->name, s->len, s->hash) : s->name);
+     return true;
+}
+
+/* Return a NULL-terminated array of the names of all saved parameters.
+   The names outlive the current file, so they are interned. */
+char **
+parm_names()
+{
+     static struct obstack stk;
+     static int inited;
+
+     if (!inited) {
+	  obstack_init(&stk);
+	  inited = 1;
+     }
+     for_each_symbol(parm_name_processor, &stk);
+     obstack_ptr_grow(&stk, NULL);
+     return obstack_finish(&stk);
 }
 
 
@@ -360,15 +916,298 @@ append_to_list(Consptr *root_ptr, void *car)
      return cons;
 }
 
+
+/* Symbol lists */
+
+#define SYMBOL_LIST_SPILL 8        /* Initial size of the array */
+
+/* Append SYM to LIST */
+void
+symbol_list_append(struct symbol_list *list, Symbol *sym)
+{
+     Symbol **vec;
+
+     sym->linked = 1;
+     if (list->max == 0) {
+	  if (list->count < SYMBOL_LIST_INLINE) {
+	       list->v.inl[list->count++] = sym;
+	       return;
+	  }
+	  vec = xmalloc(SYMBOL_LIST_SPILL * sizeof(*vec));
+	  memcpy(vec, list->v.inl, list->count * sizeof(*vec));
+	  list->v.vec = vec;
+	  list->max = SYMBOL_LIST_SPILL;
+     } else if (list->count == list->max) {
+	  list->max *= 2;
+	  list->v.vec = xrealloc(list->v.vec,
+				 list->max * sizeof(*list->v.vec));
+     }
+     list->v.vec[list->count++] = sym;
+}
+
 int
-symbol_in_list(Symbol *sym, Consptr list)
+symbol_in_list(Symbol *sym, struct symbol_list *list)
 {
-     Consptr cons;
+     Symbol **p = SYMBOL_LIST_PTR(list);
+     unsigned i;
      
-     if (!list)
-	  return 0;
-     for (cons = CAR(list); cons; cons = CDR(cons))
-	  if ((Symbol*)CAR(cons) == sym)
+     for (i = 0; i < list->count; i++)
+	  if (p[i] == sym)
 	       return 1;
      return 0;
 }
+
+/* Empty LIST */
+void
+symbol_list_free(struct symbol_list *list)
+{
+     if (list->max)
+	  free(list->v.vec);
+     list->count = list->max = 0;
+}
+
+
+/* Reference lists. The references to a symbol are packed into a byte
+ * array, in the order they were found. A reference to the same file
+ * as the previous one is stored as the difference between their line
+ * numbers, any other one as the file id followed by the line number.
+ * Numbers are written 7 bits per byte, least significant bits first,
+ * with the high bit set in all bytes but the last. The lowest bit of
+ * the first number tells the two forms apart.
+ */
+struct ref_list {
+     unsigned char *buf;
+     size_t size;                  /* Number of bytes used */
+     size_t max;                   /* Number of bytes allocated */
+     int source;                   /* Location of the last reference */
+     int line;
+     size_t resident;              /* 1 + index in resident_refs, 0 if
+				      buf is not allocated */
+     size_t spilled;               /* Number of bytes in the spill file */
+     off_t spill;                  /* Offset of the last spilled segment */
+};
+
+/* With --max-memory, the reference lists are written out to a
+ * temporary file (the spill file) whenever the memory they take
+ * exceeds the limit at the end of a source file. Each list goes out as
+ * a segment, which is preceded by a struct ref_segment and is linked
+ * to the previous segment of the same list. The in-memory part of the
+ * list starts empty again, and goes on where the spilled part ended,
+ * since the location of the last reference is kept in the list.
+ * next_ref() reads the segments back in one buffer.
+ */
+struct ref_segment {
+     off_t prev;                   /* Offset of the previous segment */
+     size_t size;                  /* Number of bytes that follow */
+};
+
+static size_t ref_memory;          /* Memory taken by the reference lists */
+static struct ref_list **resident_refs; /* Lists with a buffer */
+static size_t resident_count;
+static size_t resident_max;
+static FILE *spill_file;
+
+#define VARINT_MAX ((sizeof(unsigned long) * 8 + 6) / 7)
+
+static void
+put_varint(struct ref_list *list, unsigned long n)
+{
+     while (n >= 0x80) {
+	  list->buf[list->size++] = (n & 0x7f) | 0x80;
+	  n >>= 7;
+     }
+     list->buf[list->size++] = n;
+}
+
+static unsigned long
+get_varint(unsigned char *buf, size_t *pos)
+{
+     unsigned long n = 0;
+     int shift = 0;
+     unsigned char c;
+
+     do {
+	  c = buf[(*pos)++];
+	  n |= (unsigned long) (c & 0x7f) << shift;
+	  shift += 7;
+     } while (c & 0x80);
+     return n;
+}
+
+static void
+add_resident(struct ref_list *list)
+{
+     if (resident_count == resident_max) {
+	  resident_max = resident_max ? 2 * resident_max : 1024;
+	  resident_refs = xrealloc(resident_refs,
+				   resident_max * sizeof(*resident_refs));
+     }
+     resident_refs[resident_count++] = list;
+     list->resident = resident_count;
+}
+
+static void
+remove_resident(struct ref_list *list)
+{
+     struct ref_list *last = resident_refs[--resident_count];
+
+     /* The last list takes its place */
+     resident_refs[list->resident - 1] = last;
+     last->resident = list->resident;
+     list->resident = 0;
+     ref_memory -= list->max;
+}
+
+/* Free the reference list LIST */
+static void
+free_ref_list(struct ref_list *list)
+{
+     if (list) {
+	  if (list->resident)
+	       remove_resident(list);
+	  free(list->buf);
+	  free(list);
+     }
+}
+
+/* Write the buffers of all reference lists to the spill file and free
+   them */
+static void
+spill_refs()
+{
+     struct ref_list *list;
+     struct ref_segment seg;
+     off_t pos;
+
+     if (!spill_file) {
+	  spill_file = tmpfile();
+	  if (!spill_file)
+	       error(1, errno, _("cannot create temporary file"));
+     }
+     if (fseeko(spill_file, 0, SEEK_END))
+	  error(1, errno, _("cannot write temporary file"));
+     while (resident_count) {
+	  list = resident_refs[resident_count - 1];
+	  if (list->size) {
+	       pos = ftello(spill_file);
+	       seg.prev = list->spill;
+	       seg.size = list->size;
+	       if (fwrite(&seg, sizeof(seg), 1, spill_file) != 1
+		   || fwrite(list->buf, list->size, 1, spill_file) != 1)
+		    error(1, errno, _("cannot write temporary file"));
+	       list->spill = pos;
+	       list->spilled += list->size;
+	  }
+	  remove_resident(list);
+	  free(list->buf);
+	  list->buf = NULL;
+	  list->size = list->max = 0;
+     }
+}
+
+/* Spill the reference lists if they take more memory than allowed.
+   Called at the end of each source file. */
+static void
+check_memory()
+{
+     if (max_memory && ref_memory > max_memory)
+	  spill_refs();
+}
+
+/* Read the whole of the spilled list LIST, followed by its in-memory
+   part, into a buffer of the given SIZE. Return the buffer, which is
+   valid until the next call. */
+static unsigned char *
+load_refs(struct ref_list *list, size_t size)
+{
+     static unsigned char *buf;
+     static size_t max;
+     struct ref_segment seg;
+     size_t end = list->spilled;
+     off_t pos = list->spill;
+     
+     if (size > max) {
+	  max = size;
+	  buf = xrealloc(buf, max);
+     }
+     memcpy(buf + end, list->buf, list->size);
+     /* The segments are linked from the last one */
+     while (end) {
+	  if (fseeko(spill_file, pos, SEEK_SET)
+	      || fread(&seg, sizeof(seg), 1, spill_file) != 1
+	      || seg.size > end
+	      || fread(buf + end - seg.size, seg.size, 1, spill_file) != 1)
+	       error(1, errno, _("cannot read temporary file"));
+	  end -= seg.size;
+	  pos = seg.prev;
+     }
+     return buf;
+}
+
+/* Append the reference SOURCE:LINE to the list *PLIST */
+void
+add_ref(struct ref_list **plist, int source, int line)
+{
+     struct ref_list *list = *plist;
+     long delta;
+     
+     if (!list) {
+	  list = *plist = xmalloc(sizeof(*list));
+	  memset(list, 0, sizeof(*list));
+     }
+     if (list->size + 2 * VARINT_MAX > list->max) {
+	  if (!list->resident)
+	       add_resident(list);
+	  ref_memory -= list->max;
+	  list->max = list->max ? 2 * list->max : 4 * VARINT_MAX;
+	  list->buf = xrealloc(list->buf, list->max);
+	  ref_memory += list->max;
+     }
+     if (source == list->source) {
+	  /* Fold the sign into the lowest bit */
+	  delta = (long) line - list->line;
+	  put_varint(list,
+		     (delta < 0 ? (-(delta + 1) << 1) | 1 : delta << 1) << 1);
+     } else {
+	  put_varint(list, ((unsigned long) source << 1) | 1);
+	  put_varint(list, line);
+	  list->source = source;
+     }
+     list->line = line;
+}
+
+/* Decode the next reference from LIST into REF. *POS is the offset of
+   the reference in the list, and should be 0 on the first call. REF
+   must keep the value it got from the previous call. Return 0 if there
+   are no more references. */
+int
+next_ref(struct ref_list *list, size_t *pos, Ref *ref)
+{
+     static struct ref_list *loaded; /* The list in the load_refs buffer */
+     static unsigned char *loaded_buf;
+     unsigned char *buf;
+     unsigned long n;
+
+     if (!list || *pos >= list->spilled + list->size)
+	  return 0;
+     if (list->spilled) {
+	  if (*pos == 0 || list != loaded) {
+	       loaded_buf = load_refs(list, list->spilled + list->size);
+	       loaded = list;
+	  }
+	  buf = loaded_buf;
+     } else
+	  buf = list->buf;
+     n = get_varint(buf, pos);
+     if (n & 1) {
+	  ref->source = n >> 1;
+	  ref->line = get_varint(buf, pos);
+     } else {
+	  n >>= 1;
+	  if (n & 1)
+	       ref->line -= (n >> 1) + 1;
+	  else
+	       ref->line += n >> 1;
+     }
+     return 1;
+}